@@ -0,0 +1,6 @@
+#!/bin/sh
+# Headless build and benchmarks for Linux. The SDL game itself is built on Windows with build.bat.
+mkdir -p bin
+cd bin
+gcc -std=c11 -O2 -march=native -Wall -Wextra -Werror ../src/headless.c -o tetris_headless -lm -pthread
+gcc -std=c11 -O2 -march=native -Wall -Wextra -Werror ../src/bench.c -o tetris_bench -lm -pthread
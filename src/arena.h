@@ -26,6 +26,21 @@ void *arena_alloc(Arena *arena, size_t size)
     return address_to_return;
 }
 
+// alignment has to be a power of two.
+void *arena_alloc_aligned(Arena *arena, size_t size, size_t alignment)
+{
+    uintptr_t address = (uintptr_t)(arena->buffer + arena->offset);
+    size_t padding = (size_t)(((address + alignment - 1) & ~(uintptr_t)(alignment - 1)) - address);
+
+    arena->offset += padding;
+    if (arena->offset > arena->buffer_length)
+    {
+        return NULL;
+    }
+
+    return arena_alloc(arena, size);
+}
+
 /*
 void arena_resize(Arena *arena, void *old_memory, size_t old_memory_length, void *new_memory_length)
 {
@@ -0,0 +1,500 @@
+// Many independent boards stepped together, for training bots.
+//
+// Everything is stored structure-of-arrays with the board index innermost, so
+// row r of every board sits in one contiguous run of uint16_t and a SIMD
+// register covers BATCH_LANES boards at once. Each board also keeps its
+// active piece drawn into a second set of rows (the piece layer), which turns
+// gravity, landing, locking and full-row checks into plain row-wise AND/OR
+// across boards. Sideways moves are a shift of the piece layer, so they are
+// done across boards too. Rotations need the kick tables and stay scalar.
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define BATCH_SSE2 1
+#endif
+
+#define BATCH_LANES 8
+
+typedef enum {
+    Action_NONE,
+    Action_LEFT,
+    Action_RIGHT,
+    Action_ROTATE_CLOCKWISE,
+    Action_ROTATE_COUNTER_CLOCKWISE,
+    Action_DROP,
+    Action_COUNT,
+} Batch_Action;
+
+typedef struct {
+    // Number of boards, and the row stride, which is count rounded up to BATCH_LANES.
+    int count;
+    int stride;
+
+    // [BOARD_HEIGHT][stride]
+    uint16_t *rows;
+    uint16_t *piece_rows;
+
+    uint8_t *type;
+    uint8_t *rotation;
+    int8_t *x;
+    int8_t *y;
+
+    // Each board deals its own pieces, see random.h.
+    Randomizer *randomizer;
+
+    // Filled in by each batch_step: lines cleared this step, and whether the
+    // board topped out (and was started again).
+    uint8_t *lines;
+    uint8_t *done;
+
+    // Scratch lane masks per action, 0xFFFF for lanes taking part.
+    uint16_t *drop_mask;
+    uint16_t *left_mask;
+    uint16_t *right_mask;
+
+    long long steps;
+    long long pieces;
+    long long total_lines;
+    long long games;
+} Batch;
+
+#ifdef BATCH_SSE2
+typedef __m128i Lanes;
+
+static inline Lanes lanes_load(uint16_t *p)            { return _mm_loadu_si128((__m128i *)p); }
+static inline void  lanes_store(uint16_t *p, Lanes a)  { _mm_storeu_si128((__m128i *)p, a); }
+static inline Lanes lanes_zero(void)                   { return _mm_setzero_si128(); }
+static inline Lanes lanes_set(uint16_t a)              { return _mm_set1_epi16((short)a); }
+static inline Lanes lanes_and(Lanes a, Lanes b)        { return _mm_and_si128(a, b); }
+static inline Lanes lanes_or(Lanes a, Lanes b)         { return _mm_or_si128(a, b); }
+static inline Lanes lanes_andnot(Lanes a, Lanes b)     { return _mm_andnot_si128(a, b); }
+static inline Lanes lanes_equal(Lanes a, Lanes b)      { return _mm_cmpeq_epi16(a, b); }
+static inline Lanes lanes_sub(Lanes a, Lanes b)        { return _mm_sub_epi16(a, b); }
+static inline Lanes lanes_shift_left(Lanes a)          { return _mm_slli_epi16(a, 1); }
+static inline Lanes lanes_shift_right(Lanes a)         { return _mm_srli_epi16(a, 1); }
+static inline bool  lanes_any(Lanes a)                 { return _mm_movemask_epi8(a) != 0; }
+#else
+typedef struct { uint16_t v[BATCH_LANES]; } Lanes;
+
+static inline Lanes lanes_load(uint16_t *p)            { Lanes r; memcpy(r.v, p, sizeof(r.v)); return r; }
+static inline void  lanes_store(uint16_t *p, Lanes a)  { memcpy(p, a.v, sizeof(a.v)); }
+static inline Lanes lanes_zero(void)                   { Lanes r; memset(r.v, 0, sizeof(r.v)); return r; }
+static inline Lanes lanes_set(uint16_t a)              { Lanes r; for (int i = 0; i < BATCH_LANES; i += 1) r.v[i] = a; return r; }
+static inline Lanes lanes_and(Lanes a, Lanes b)        { for (int i = 0; i < BATCH_LANES; i += 1) a.v[i] &= b.v[i]; return a; }
+static inline Lanes lanes_or(Lanes a, Lanes b)         { for (int i = 0; i < BATCH_LANES; i += 1) a.v[i] |= b.v[i]; return a; }
+static inline Lanes lanes_andnot(Lanes a, Lanes b)     { for (int i = 0; i < BATCH_LANES; i += 1) a.v[i] = (uint16_t)(~a.v[i] & b.v[i]); return a; }
+static inline Lanes lanes_equal(Lanes a, Lanes b)      { for (int i = 0; i < BATCH_LANES; i += 1) a.v[i] = a.v[i] == b.v[i] ? 0xFFFF : 0; return a; }
+static inline Lanes lanes_sub(Lanes a, Lanes b)        { for (int i = 0; i < BATCH_LANES; i += 1) a.v[i] = (uint16_t)(a.v[i] - b.v[i]); return a; }
+static inline Lanes lanes_shift_left(Lanes a)          { for (int i = 0; i < BATCH_LANES; i += 1) a.v[i] = (uint16_t)(a.v[i] << 1); return a; }
+static inline Lanes lanes_shift_right(Lanes a)         { for (int i = 0; i < BATCH_LANES; i += 1) a.v[i] = (uint16_t)(a.v[i] >> 1); return a; }
+static inline bool  lanes_any(Lanes a)                 { for (int i = 0; i < BATCH_LANES; i += 1) if (a.v[i]) return true; return false; }
+#endif
+
+// Pick lanes from a where mask is set, b elsewhere.
+static inline Lanes lanes_select(Lanes mask, Lanes a, Lanes b)
+{
+    return lanes_or(lanes_and(mask, a), lanes_andnot(mask, b));
+}
+
+size_t batch_memory_size(int count)
+{
+    size_t stride = (size_t)((count + BATCH_LANES - 1) / BATCH_LANES * BATCH_LANES);
+    return stride * (2 * BOARD_HEIGHT * sizeof(uint16_t) + 6 + sizeof(Randomizer) + 3 * sizeof(uint16_t)) + sizeof(uint64_t);
+}
+
+static inline uint16_t *batch_row(uint16_t *rows, Batch *batch, int row)
+{
+    return rows + (size_t)row * (size_t)batch->stride;
+}
+
+// Would the piece fit at this spot on one board? Cells above the top of the board
+// can't be stored in the piece layer, so they count as blocked here.
+bool batch_fits(Batch *batch, int lane, int type, int rotation, int x, int y)
+{
+    const uint16_t *shape = piece_shapes[type][rotation];
+    if (x < -BOARD_PADDING) return false;
+
+    for (int j = 0; j < 4; j += 1)
+    {
+        uint32_t piece_row = (uint32_t)shape[j] << (x + BOARD_PADDING);
+        if (!piece_row) continue;
+
+        int row = y + j;
+        if (row < 0 || row >= BOARD_HEIGHT) return false;
+
+        uint32_t board_row = BOARD_WALLS | ((uint32_t)batch_row(batch->rows, batch, row)[lane] << BOARD_PADDING);
+        if (piece_row & board_row) return false;
+    }
+
+    return true;
+}
+
+// Draw (or with set false, erase) the active piece of one board into the piece layer.
+void batch_draw_piece(Batch *batch, int lane, bool set)
+{
+    const uint16_t *shape = piece_shapes[batch->type[lane]][batch->rotation[lane]];
+    int x = batch->x[lane];
+    int y = batch->y[lane];
+
+    for (int j = 0; j < 4; j += 1)
+    {
+        int row = y + j;
+        if (!shape[j] || row < 0 || row >= BOARD_HEIGHT) continue;
+
+        uint16_t bits = (uint16_t)((((uint32_t)shape[j] << (x + BOARD_PADDING)) >> BOARD_PADDING) & BOARD_FULL_ROW);
+        uint16_t *cell = &batch_row(batch->piece_rows, batch, row)[lane];
+        *cell = set ? bits : 0;
+    }
+}
+
+// Start the next piece on one board. Returns false if it doesn't fit, which is a top out.
+bool batch_spawn(Batch *batch, int lane)
+{
+    batch->type[lane] = (uint8_t)randomizer_next(&batch->randomizer[lane]);
+    batch->rotation[lane] = 0;
+    batch->x[lane] = (BOARD_WIDTH/2) - 2;
+    batch->y[lane] = 0;
+
+    if (lane < batch->count) batch->pieces += 1;
+
+    if (!batch_fits(batch, lane, batch->type[lane], 0, batch->x[lane], 0)) return false;
+
+    batch_draw_piece(batch, lane, true);
+    return true;
+}
+
+void batch_restart(Batch *batch, int lane)
+{
+    for (int row = 0; row < BOARD_HEIGHT; row += 1)
+    {
+        batch_row(batch->rows, batch, row)[lane] = 0;
+        batch_row(batch->piece_rows, batch, row)[lane] = 0;
+    }
+
+    batch_spawn(batch, lane);
+}
+
+// Board i deals pieces from seed + i.
+void batch_init(Batch *batch, Arena *arena, int count, uint64_t seed)
+{
+    int stride = (count + BATCH_LANES - 1) / BATCH_LANES * BATCH_LANES;
+    size_t rows_size = (size_t)stride * BOARD_HEIGHT * sizeof(uint16_t);
+
+    batch->count = count;
+    batch->stride = stride;
+
+    batch->randomizer = arena_alloc_aligned(arena, (size_t)stride * sizeof(Randomizer), sizeof(uint64_t));
+    batch->rows       = arena_alloc(arena, rows_size);
+    batch->piece_rows = arena_alloc(arena, rows_size);
+    batch->drop_mask  = arena_alloc(arena, (size_t)stride * sizeof(uint16_t));
+    batch->left_mask  = arena_alloc(arena, (size_t)stride * sizeof(uint16_t));
+    batch->right_mask = arena_alloc(arena, (size_t)stride * sizeof(uint16_t));
+    batch->type       = arena_alloc(arena, (size_t)stride);
+    batch->rotation   = arena_alloc(arena, (size_t)stride);
+    batch->x          = arena_alloc(arena, (size_t)stride);
+    batch->y          = arena_alloc(arena, (size_t)stride);
+    batch->lines      = arena_alloc(arena, (size_t)stride);
+    batch->done       = arena_alloc(arena, (size_t)stride);
+
+    batch->steps = 0;
+    batch->pieces = 0;
+    batch->total_lines = 0;
+    batch->games = 0;
+
+    for (int lane = 0; lane < stride; lane += 1)
+    {
+        randomizer_init(&batch->randomizer[lane], seed + (uint64_t)lane, 1);
+    }
+
+    // Padding lanes get a board too, so the vector loops never need a tail.
+    for (int lane = 0; lane < stride; lane += 1)
+    {
+        batch_restart(batch, lane);
+    }
+
+    batch->pieces = 0;
+}
+
+// Rotations, one board at a time.
+void batch_rotate(Batch *batch, int lane, int action)
+{
+    int type = batch->type[lane];
+    int rotation = batch->rotation[lane];
+    int x = batch->x[lane];
+    int y = batch->y[lane];
+
+    if (type == O) return;
+
+    Rotate_Direction direction = action == Action_ROTATE_CLOCKWISE ? Rotate_CLOCKWISE : Rotate_COUNTER_CLOCKWISE;
+    int new_rotation = direction == Rotate_CLOCKWISE ? (rotation + 1) & 3 : (rotation + 3) & 3;
+    const Kick *kicks = (type == I) ? kicks_i[rotation][direction] : kicks_jlstz[rotation][direction];
+
+    for (int test = 0; test < 5; test += 1)
+    {
+        Kick k = kicks[test];
+        int new_x = x + k.x;
+        int new_y = y - k.y;
+
+        if (batch_fits(batch, lane, type, new_rotation, new_x, new_y))
+        {
+            batch_draw_piece(batch, lane, false);
+            batch->rotation[lane] = (uint8_t)new_rotation;
+            batch->x[lane] = (int8_t)new_x;
+            batch->y[lane] = (int8_t)new_y;
+            batch_draw_piece(batch, lane, true);
+            return;
+        }
+    }
+}
+
+// The rows the pieces of the lanes in mask can be in, as [top, bottom).
+static inline void batch_piece_span(Batch *batch, int lane, Lanes mask, int *top, int *bottom)
+{
+    uint16_t in_mask[BATCH_LANES];
+    lanes_store(in_mask, mask);
+
+    int min_y = BOARD_HEIGHT;
+    int max_y = -4;
+
+    for (int i = 0; i < BATCH_LANES; i += 1)
+    {
+        if (!in_mask[i]) continue;
+
+        int y = batch->y[lane + i];
+        if (y < min_y) min_y = y;
+        if (y > max_y) max_y = y;
+    }
+
+    *top = min_y < 0 ? 0 : min_y;
+    *bottom = max_y + 4 > BOARD_HEIGHT ? BOARD_HEIGHT : max_y + 4;
+}
+
+// Lanes in the group whose piece would be resting on something if it were
+// distance rows lower. Only rows [top, bottom) of the piece layer are looked at.
+static inline Lanes batch_landed(Batch *batch, int lane, int distance, int top, int bottom)
+{
+    Lanes landed = lanes_zero();
+
+    for (int row = top; row < bottom; row += 1)
+    {
+        int row_below = row + distance + 1;
+
+        Lanes piece = lanes_load(&batch_row(batch->piece_rows, batch, row)[lane]);
+        Lanes below = (row_below >= BOARD_HEIGHT) ? lanes_set(0xFFFF) : lanes_load(&batch_row(batch->rows, batch, row_below)[lane]);
+        landed = lanes_or(landed, lanes_and(piece, below));
+    }
+
+    return lanes_andnot(lanes_equal(landed, lanes_zero()), lanes_set(0xFFFF));
+}
+
+// Shift the piece layer down a row in the lanes of move.
+static inline void batch_move_down(Batch *batch, int lane, Lanes move, int top, int bottom)
+{
+    if (bottom == BOARD_HEIGHT) bottom -= 1;
+
+    for (int row = bottom; row > top; row -= 1)
+    {
+        uint16_t *p = &batch_row(batch->piece_rows, batch, row)[lane];
+        Lanes above = lanes_load(&batch_row(batch->piece_rows, batch, row-1)[lane]);
+        lanes_store(p, lanes_select(move, above, lanes_load(p)));
+    }
+
+    uint16_t *p = &batch_row(batch->piece_rows, batch, top)[lane];
+    lanes_store(p, lanes_andnot(move, lanes_load(p)));
+
+    uint16_t moved[BATCH_LANES];
+    lanes_store(moved, move);
+    for (int i = 0; i < BATCH_LANES; i += 1)
+    {
+        if (moved[i]) batch->y[lane + i] = (int8_t)(batch->y[lane + i] + 1);
+    }
+}
+
+// Move the pieces of the lanes in left/right one column over, unless that would
+// take them through a wall or into locked cells.
+static inline void batch_move_sideways(Batch *batch, int lane, Lanes left, Lanes right)
+{
+    int top, bottom;
+    batch_piece_span(batch, lane, lanes_or(left, right), &top, &bottom);
+
+    Lanes left_wall = lanes_set(1);
+    Lanes right_wall = lanes_set(1 << (BOARD_WIDTH-1));
+    Lanes blocked = lanes_zero();
+
+    for (int row = top; row < bottom; row += 1)
+    {
+        Lanes piece = lanes_load(&batch_row(batch->piece_rows, batch, row)[lane]);
+        Lanes cells = lanes_load(&batch_row(batch->rows, batch, row)[lane]);
+
+        // Bit 0 is the leftmost column, so moving left is a right shift.
+        Lanes moved = lanes_select(left, lanes_shift_right(piece), lanes_shift_left(piece));
+
+        blocked = lanes_or(blocked, lanes_and(moved, cells));
+        blocked = lanes_or(blocked, lanes_and(left, lanes_and(piece, left_wall)));
+        blocked = lanes_or(blocked, lanes_and(right, lanes_and(piece, right_wall)));
+    }
+
+    Lanes can_move = lanes_equal(blocked, lanes_zero());
+    left = lanes_and(can_move, left);
+    right = lanes_and(can_move, right);
+    Lanes moving = lanes_or(left, right);
+    if (!lanes_any(moving)) return;
+
+    for (int row = top; row < bottom; row += 1)
+    {
+        uint16_t *p = &batch_row(batch->piece_rows, batch, row)[lane];
+        Lanes piece = lanes_load(p);
+        Lanes moved = lanes_select(left, lanes_shift_right(piece), lanes_shift_left(piece));
+        lanes_store(p, lanes_select(moving, moved, piece));
+    }
+
+    uint16_t went_left[BATCH_LANES];
+    uint16_t went_right[BATCH_LANES];
+    lanes_store(went_left, left);
+    lanes_store(went_right, right);
+
+    for (int i = 0; i < BATCH_LANES; i += 1)
+    {
+        if (went_left[i]) batch->x[lane + i] = (int8_t)(batch->x[lane + i] - 1);
+        if (went_right[i]) batch->x[lane + i] = (int8_t)(batch->x[lane + i] + 1);
+    }
+}
+
+// Remove the full rows of one board in a single pass. Returns how many there were.
+int batch_clear_rows(Batch *batch, int lane)
+{
+    int lines = 0;
+    int write = BOARD_HEIGHT-1;
+
+    for (int read = BOARD_HEIGHT-1; read >= 0; read -= 1)
+    {
+        uint16_t row = batch_row(batch->rows, batch, read)[lane];
+        if (row == BOARD_FULL_ROW)
+        {
+            lines += 1;
+            continue;
+        }
+
+        batch_row(batch->rows, batch, write)[lane] = row;
+        write -= 1;
+    }
+
+    for (; write >= 0; write -= 1) batch_row(batch->rows, batch, write)[lane] = 0;
+
+    return lines;
+}
+
+// Advance every board by one step: apply its action, then gravity. Drop
+// lands the piece straight away. Landed pieces lock, full rows clear and the
+// next piece spawns; boards that top out start a new game and report done.
+void batch_step(Batch *batch, const uint8_t *actions)
+{
+    memset(batch->lines, 0, (size_t)batch->stride);
+    memset(batch->done, 0, (size_t)batch->stride);
+
+    for (int lane = 0; lane < batch->count; lane += 1)
+    {
+        uint8_t action = actions[lane];
+        batch->drop_mask[lane]  = action == Action_DROP  ? 0xFFFF : 0;
+        batch->left_mask[lane]  = action == Action_LEFT  ? 0xFFFF : 0;
+        batch->right_mask[lane] = action == Action_RIGHT ? 0xFFFF : 0;
+
+        if (action == Action_ROTATE_CLOCKWISE || action == Action_ROTATE_COUNTER_CLOCKWISE)
+        {
+            batch_rotate(batch, lane, action);
+        }
+    }
+
+    Lanes full_row = lanes_set(BOARD_FULL_ROW);
+
+    for (int lane = 0; lane < batch->stride; lane += BATCH_LANES)
+    {
+        // Sideways: shift the lanes moving left or right one column over.
+        Lanes left = lanes_load(&batch->left_mask[lane]);
+        Lanes right = lanes_load(&batch->right_mask[lane]);
+        if (lanes_any(lanes_or(left, right))) batch_move_sideways(batch, lane, left, right);
+
+        // Drop: probe further and further down for the dropping lanes only,
+        // counting how far each one gets, then move them in one go.
+        int top, bottom;
+        Lanes all = lanes_set(0xFFFF);
+        Lanes dropping = lanes_load(&batch->drop_mask[lane]);
+
+        if (lanes_any(dropping))
+        {
+            Lanes distance = lanes_zero();
+            batch_piece_span(batch, lane, dropping, &top, &bottom);
+
+            for (int d = 0; lanes_any(dropping); d += 1)
+            {
+                dropping = lanes_andnot(batch_landed(batch, lane, d, top, bottom), dropping);
+                distance = lanes_sub(distance, dropping);
+            }
+
+            uint16_t distances[BATCH_LANES];
+            lanes_store(distances, distance);
+
+            for (int i = 0; i < BATCH_LANES; i += 1)
+            {
+                if (!distances[i]) continue;
+
+                batch_draw_piece(batch, lane + i, false);
+                batch->y[lane + i] = (int8_t)(batch->y[lane + i] + distances[i]);
+                batch_draw_piece(batch, lane + i, true);
+            }
+        }
+
+        // Gravity for everyone else, lock whoever has landed.
+        batch_piece_span(batch, lane, all, &top, &bottom);
+        Lanes landed = batch_landed(batch, lane, 0, top, bottom);
+        Lanes falling = lanes_andnot(landed, lanes_andnot(lanes_load(&batch->drop_mask[lane]), all));
+        if (lanes_any(falling)) batch_move_down(batch, lane, falling, top, bottom);
+
+        if (!lanes_any(landed)) continue;
+
+        // Only rows the landed pieces cover can have changed, so only those can be full now.
+        batch_piece_span(batch, lane, landed, &top, &bottom);
+
+        Lanes any_full = lanes_zero();
+        for (int row = top; row < bottom; row += 1)
+        {
+            uint16_t *r = &batch_row(batch->rows, batch, row)[lane];
+            uint16_t *p = &batch_row(batch->piece_rows, batch, row)[lane];
+
+            Lanes piece = lanes_load(p);
+            Lanes locked = lanes_or(lanes_load(r), lanes_and(landed, piece));
+
+            lanes_store(r, locked);
+            lanes_store(p, lanes_andnot(landed, piece));
+
+            any_full = lanes_or(any_full, lanes_and(landed, lanes_equal(locked, full_row)));
+        }
+
+        uint16_t landed_lanes[BATCH_LANES];
+        uint16_t full_lanes[BATCH_LANES];
+        lanes_store(landed_lanes, landed);
+        lanes_store(full_lanes, any_full);
+
+        for (int i = 0; i < BATCH_LANES; i += 1)
+        {
+            if (!landed_lanes[i]) continue;
+            int l = lane + i;
+
+            if (full_lanes[i])
+            {
+                int lines = batch_clear_rows(batch, l);
+                batch->lines[l] = (uint8_t)lines;
+                if (l < batch->count) batch->total_lines += lines;
+            }
+
+            if (!batch_spawn(batch, l))
+            {
+                batch->done[l] = 1;
+                if (l < batch->count) batch->games += 1;
+                batch_restart(batch, l);
+            }
+        }
+    }
+
+    batch->steps += batch->count;
+}
@@ -0,0 +1,457 @@
+// Microbenchmarks for the game's hot paths, so changes to them can be judged
+// by numbers. Every benchmark runs over the same corpus of boards, taken from
+// bot games with fixed seeds at fixed ticks, so the numbers are comparable
+// between runs and builds.
+//
+// Each benchmark is warmed up, then sized so a sample takes about --sample-ms,
+// then timed for --samples samples. The median ns per operation is the number
+// to compare; min and the spread say how much to trust it.
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "arena.h"
+#include "platform.h"
+#include "trace.h"
+#include "pool.h"
+#include "random.h"
+#include "game.h"
+#include "replay.h"
+#include "bot.h"
+
+// Both powers of two, for indexing with a mask.
+#define BENCH_CASES        1024
+#define BENCH_CLEAR_BOARDS 256
+
+// Ticks of recorded bot input for the game_update benchmark.
+#define BENCH_TICKS        (1 << 16)
+
+#define BENCH_RATE         60
+#define BENCH_MAX_SAMPLES  100
+
+// A board and a piece on it, as the game had them at some tick.
+typedef struct {
+    Board board;
+    Tetronimo piece;
+} Bench_Case;
+
+typedef struct {
+    Bench_Case cases[BENCH_CASES];
+
+    // The same pieces moved across the whole width and past the walls.
+    Tetronimo wall_pieces[BENCH_CASES];
+
+    // The same pieces dropped to where they would land.
+    Tetronimo landed_pieces[BENCH_CASES];
+
+    // Boards with full rows waiting to go.
+    Board clear_boards[BENCH_CLEAR_BOARDS];
+
+    // Scratch space for the benchmarks that change the board.
+    Board scratch;
+
+    // Input bits (see replay.h) the bot gave each tick of one game, replayed on replay_game.
+    uint8_t inputs[BENCH_TICKS];
+    int input_count;
+    uint64_t replay_seed;
+    Game *replay_game;
+    uint64_t replay_tick;
+} Bench_Corpus;
+
+typedef struct {
+    const char *name;
+
+    // Do the operation count times. Returns something that depends on every
+    // result, so none of them can be optimized away.
+    uint64_t (*run)(Bench_Corpus *corpus, int count);
+} Benchmark;
+
+// Start replay_game over as a fresh game from the recorded seed, so it plays
+// the same ticks that were recorded.
+static void bench_restart_replay(Bench_Corpus *corpus)
+{
+    Game *g = corpus->replay_game;
+    g->seed = corpus->replay_seed;
+    g->preview = 1;
+    g->clear_time = CLEAR_TIME;
+    game_reset(g);
+
+    corpus->replay_tick = 0;
+}
+
+// Play bot games from seed 1 on and keep a board every 37 ticks, and every
+// board that has rows waiting to clear, until there are enough of both.
+void bench_build_corpus(Bench_Corpus *corpus, Arena *arena)
+{
+    Game *game = arena_alloc_aligned(arena, sizeof(Game), CACHE_LINE);
+    Bot *bot = arena_alloc_aligned(arena, sizeof(Bot), CACHE_LINE);
+    game_init(game, arena);
+
+    int cases = 0;
+    int clears = 0;
+    uint64_t seed = 1;
+
+    while (cases < BENCH_CASES || clears < BENCH_CLEAR_BOARDS)
+    {
+        memset(bot, 0, sizeof(Bot));
+        game->seed = seed;
+        game->preview = 1;
+        game->clear_time = CLEAR_TIME;
+        game_reset(game);
+
+        // A few hundred pieces per game, so boards from early and late games both show up.
+        int max_pieces = 100 + (int)(seed % 8) * 50;
+
+        for (uint64_t tick = 0; !game->reset && game->board.pieces < max_pieces; tick += 1)
+        {
+            bot_drive(bot, game);
+            game_update(game, game_tick_dt(BENCH_RATE, tick));
+
+            Board *b = &game->board;
+            Tetronimo *active = get_active(b);
+
+            if (cases < BENCH_CASES && active && tick % 37 == 0)
+            {
+                Bench_Case *c = &corpus->cases[cases];
+                c->board = *b;
+                c->piece = *active;
+
+                Tetronimo *wall = &corpus->wall_pieces[cases];
+                *wall = *active;
+                wall->x = (cases % (BOARD_WIDTH + 4)) - 3;
+
+                Tetronimo *landed = &corpus->landed_pieces[cases];
+                *landed = *active;
+                landed->y += drop_distance(landed, b);
+
+                cases += 1;
+            }
+
+            if (clears < BENCH_CLEAR_BOARDS && b->rows_to_clear && game->clear_timer == 0)
+            {
+                corpus->clear_boards[clears] = *b;
+                clears += 1;
+            }
+        }
+
+        seed += 1;
+    }
+
+    // One more game, with its inputs kept for replaying.
+    memset(bot, 0, sizeof(Bot));
+    corpus->replay_seed = seed;
+    corpus->replay_game = game;
+    bench_restart_replay(corpus);
+
+    corpus->input_count = 0;
+    while (corpus->input_count < BENCH_TICKS && !game->reset)
+    {
+        bot_drive(bot, game);
+        corpus->inputs[corpus->input_count] = game_get_input(game);
+        game_update(game, game_tick_dt(BENCH_RATE, (uint64_t)corpus->input_count));
+        corpus->input_count += 1;
+    }
+
+    bench_restart_replay(corpus);
+}
+
+static uint64_t bench_solid_below(Bench_Corpus *corpus, int count)
+{
+    uint64_t sum = 0;
+    for (int i = 0; i < count; i += 1)
+    {
+        Bench_Case *c = &corpus->cases[i & (BENCH_CASES - 1)];
+        sum += solid_below(&c->piece, &c->board);
+    }
+
+    return sum;
+}
+
+static uint64_t bench_collides_with_wall(Bench_Corpus *corpus, int count)
+{
+    uint64_t sum = 0;
+    for (int i = 0; i < count; i += 1)
+    {
+        int k = i & (BENCH_CASES - 1);
+        sum += collides_with_wall(&corpus->wall_pieces[k], &corpus->cases[k].board);
+    }
+
+    return sum;
+}
+
+static uint64_t bench_collides_with_cells(Bench_Corpus *corpus, int count)
+{
+    uint64_t sum = 0;
+    for (int i = 0; i < count; i += 1)
+    {
+        int k = i & (BENCH_CASES - 1);
+        sum += collides_with_cells(&corpus->landed_pieces[k], &corpus->cases[k].board);
+    }
+
+    return sum;
+}
+
+static uint64_t bench_drop_distance(Bench_Corpus *corpus, int count)
+{
+    uint64_t sum = 0;
+    for (int i = 0; i < count; i += 1)
+    {
+        Bench_Case *c = &corpus->cases[i & (BENCH_CASES - 1)];
+        sum += (uint64_t)drop_distance(&c->piece, &c->board);
+    }
+
+    return sum;
+}
+
+// Includes putting the scratch board's rows and column tops back, about 60 bytes.
+static uint64_t bench_transform_to_tetrons(Bench_Corpus *corpus, int count)
+{
+    Board *scratch = &corpus->scratch;
+    uint64_t sum = 0;
+
+    for (int i = 0; i < count; i += 1)
+    {
+        int k = i & (BENCH_CASES - 1);
+        Board *b = &corpus->cases[k].board;
+
+        memcpy(scratch->rows, b->rows, sizeof(b->rows));
+        memcpy(scratch->column_top, b->column_top, sizeof(b->column_top));
+        scratch->width = b->width;
+        scratch->height = b->height;
+
+        transform_to_tetrons(&corpus->landed_pieces[k], scratch);
+        sum += scratch->rows[BOARD_HEIGHT - 1];
+    }
+
+    return sum;
+}
+
+static uint64_t bench_rotate(Bench_Corpus *corpus, int count)
+{
+    uint64_t sum = 0;
+    for (int i = 0; i < count; i += 1)
+    {
+        Bench_Case *c = &corpus->cases[i & (BENCH_CASES - 1)];
+        Tetronimo t = c->piece;
+
+        sum += rotate_tetronimo(&t, &c->board, (i & 1) ? Rotate_CLOCKWISE : Rotate_COUNTER_CLOCKWISE);
+        sum += (uint64_t)(t.x + t.y);
+    }
+
+    return sum;
+}
+
+static uint64_t bench_make_tetronimo(Bench_Corpus *corpus, int count)
+{
+    (void)corpus;
+    uint64_t sum = 0;
+
+    for (int i = 0; i < count; i += 1)
+    {
+        Tetronimo t = make_tetronimo((Tetronimo_Type)((i % 7) + 1), (BOARD_WIDTH/2)-2, 0);
+        sum += (uint64_t)(t.type + t.x + t.rotation);
+    }
+
+    return sum;
+}
+
+// Boards with their waiting rows forgotten, so there's something to find.
+static uint64_t bench_find_full_rows(Bench_Corpus *corpus, int count)
+{
+    uint64_t sum = 0;
+    for (int i = 0; i < count; i += 1)
+    {
+        Board *b = &corpus->clear_boards[i & (BENCH_CLEAR_BOARDS - 1)];
+        uint32_t waiting = b->rows_to_clear;
+
+        b->rows_to_clear = 0;
+        sum += find_full_rows(b);
+        b->rows_to_clear = waiting;
+    }
+
+    return sum;
+}
+
+// Includes copying the rows and cell types to the scratch board, about 250 bytes.
+static uint64_t bench_clear_rows(Bench_Corpus *corpus, int count)
+{
+    Board *scratch = &corpus->scratch;
+    uint64_t sum = 0;
+
+    for (int i = 0; i < count; i += 1)
+    {
+        Board *b = &corpus->clear_boards[i & (BENCH_CLEAR_BOARDS - 1)];
+
+        memcpy(scratch->rows, b->rows, sizeof(b->rows));
+        memcpy(scratch->cell_types, b->cell_types, sizeof(b->cell_types));
+        scratch->rows_to_clear = b->rows_to_clear;
+        scratch->width = b->width;
+        scratch->height = b->height;
+
+        clear_rows(scratch);
+        sum += scratch->rows[BOARD_HEIGHT - 1];
+    }
+
+    return sum;
+}
+
+// Replays the recorded game one tick per operation, starting over when it runs out.
+static uint64_t bench_game_update(Bench_Corpus *corpus, int count)
+{
+    Game *g = corpus->replay_game;
+    uint64_t sum = 0;
+
+    for (int i = 0; i < count; i += 1)
+    {
+        if (corpus->replay_tick == (uint64_t)corpus->input_count) bench_restart_replay(corpus);
+
+        game_set_input(g, corpus->inputs[corpus->replay_tick]);
+        game_update(g, game_tick_dt(BENCH_RATE, corpus->replay_tick));
+        corpus->replay_tick += 1;
+
+        sum += (uint64_t)g->board.score;
+    }
+
+    return sum;
+}
+
+static Benchmark benchmarks[] = {
+    {"solid_below",          bench_solid_below},
+    {"collides_with_wall",   bench_collides_with_wall},
+    {"collides_with_cells",  bench_collides_with_cells},
+    {"drop_distance",        bench_drop_distance},
+    {"transform_to_tetrons", bench_transform_to_tetrons},
+    {"rotate_tetronimo",     bench_rotate},
+    {"make_tetronimo",       bench_make_tetronimo},
+    {"find_full_rows",       bench_find_full_rows},
+    {"clear_rows",           bench_clear_rows},
+    {"game_update",          bench_game_update},
+};
+
+volatile uint64_t bench_sink;
+
+static int bench_compare(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nanoseconds per operation for one sample of count operations.
+static double bench_sample(Benchmark *benchmark, Bench_Corpus *corpus, int count)
+{
+    uint64_t start = time_now_ns();
+    bench_sink += benchmark->run(corpus, count);
+    uint64_t end = time_now_ns();
+
+    return (double)(end - start) / (double)count;
+}
+
+void bench_run(Benchmark *benchmark, Bench_Corpus *corpus, int samples, int sample_ms)
+{
+    // Double the count until a sample takes long enough, which also warms up
+    // the caches and branch predictors. Then one more sample for good measure.
+    int count = 1024;
+    uint64_t target = (uint64_t)sample_ms * 1000000;
+
+    while (count < (1 << 30))
+    {
+        uint64_t start = time_now_ns();
+        bench_sink += benchmark->run(corpus, count);
+        if (time_now_ns() - start >= target) break;
+        count *= 2;
+    }
+
+    bench_sample(benchmark, corpus, count);
+
+    double results[BENCH_MAX_SAMPLES];
+    double sum = 0.0;
+
+    for (int i = 0; i < samples; i += 1)
+    {
+        results[i] = bench_sample(benchmark, corpus, count);
+        sum += results[i];
+    }
+
+    double mean = sum / samples;
+    double variance = 0.0;
+    for (int i = 0; i < samples; i += 1)
+    {
+        variance += (results[i] - mean) * (results[i] - mean);
+    }
+    double deviation = samples > 1 ? sqrt(variance / (samples - 1)) : 0.0;
+
+    qsort(results, (size_t)samples, sizeof(double), bench_compare);
+    double median = results[samples / 2];
+
+    printf("%-22s %10.2f %10.2f %8.1f%% %12.2f\n",
+           benchmark->name, median, results[0], mean > 0.0 ? 100.0 * deviation / mean : 0.0,
+           median > 0.0 ? 1000.0 / median : 0.0);
+}
+
+void print_usage(void)
+{
+    printf("Usage: tetris_bench [options] [name ...]\n");
+    printf("  Runs the benchmarks whose names contain any of the names, or all of them.\n");
+    printf("  --samples N      Timed samples per benchmark (default 15, at most %d).\n", BENCH_MAX_SAMPLES);
+    printf("  --sample-ms N    Roughly how long each sample takes (default 20).\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int samples = 15;
+    int sample_ms = 20;
+    char *filters[16];
+    int filter_count = 0;
+
+    for (int i = 1; i < argc; i += 1)
+    {
+        bool has_value = i + 1 < argc;
+
+        if (!strcmp(argv[i], "--samples") && has_value) samples = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--sample-ms") && has_value) sample_ms = atoi(argv[++i]);
+        else if (argv[i][0] != '-' && filter_count < 16) filters[filter_count++] = argv[i];
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (samples < 1) samples = 1;
+    if (samples > BENCH_MAX_SAMPLES) samples = BENCH_MAX_SAMPLES;
+    if (sample_ms < 1) sample_ms = 1;
+
+    size_t memory_size = 64 * 1024;
+    void *memory = malloc(memory_size);
+    Arena arena;
+    arena_init(&arena, memory, memory_size);
+
+    Bench_Corpus *corpus = calloc(1, sizeof(Bench_Corpus));
+    bench_build_corpus(corpus, &arena);
+
+    printf("%d boards, %d with full rows, %d ticks of recorded input, %d samples of ~%d ms\n\n",
+           BENCH_CASES, BENCH_CLEAR_BOARDS, corpus->input_count, samples, sample_ms);
+    printf("%-22s %10s %10s %9s %12s\n", "benchmark", "ns/op", "min ns/op", "spread", "Mops/s");
+
+    for (int i = 0; i < (int)(sizeof(benchmarks) / sizeof(benchmarks[0])); i += 1)
+    {
+        bool wanted = filter_count == 0;
+        for (int f = 0; f < filter_count; f += 1)
+        {
+            if (strstr(benchmarks[i].name, filters[f])) wanted = true;
+        }
+
+        if (wanted) bench_run(&benchmarks[i], corpus, samples, sample_ms);
+    }
+
+    free(corpus);
+    free(memory);
+    return 0;
+}
@@ -0,0 +1,168 @@
+// A benchmark of the whole game loop, for seeing what frames really cost
+// without vsync hiding it. The bot plays, but through the front door: its
+// inputs go in as SDL key events, so reading input, update_game and
+// render_game all run as they do for a player. Every frame runs exactly one
+// tick, so with the same seed every run plays the same game.
+//
+// Allocations are counted by giving SDL counting memory functions, so they
+// cover SDL, SDL_ttf and the render backends. The game's own memory is
+// arenas set up front, apart from the replay buffer.
+//
+// It runs with the dummy or offscreen video drivers (SDL_VIDEODRIVER=dummy)
+// on machines without a display, on the software renderer.
+
+typedef struct {
+    int frames;
+    int count;
+
+    // Seconds and allocations of each frame.
+    double *times;
+    int *allocations;
+
+    Bot bot;
+
+    Uint64 frequency;
+    Uint64 start;
+    Uint64 frame_start;
+    int frame_allocations;
+} Frame_Benchmark;
+
+static SDL_atomic_t benchmark_allocations;
+static SDL_malloc_func benchmark_real_malloc;
+static SDL_calloc_func benchmark_real_calloc;
+static SDL_realloc_func benchmark_real_realloc;
+static SDL_free_func benchmark_real_free;
+
+static void *SDLCALL benchmark_malloc(size_t size)
+{
+    SDL_AtomicAdd(&benchmark_allocations, 1);
+    return benchmark_real_malloc(size);
+}
+
+static void *SDLCALL benchmark_calloc(size_t count, size_t size)
+{
+    SDL_AtomicAdd(&benchmark_allocations, 1);
+    return benchmark_real_calloc(count, size);
+}
+
+static void *SDLCALL benchmark_realloc(void *memory, size_t size)
+{
+    SDL_AtomicAdd(&benchmark_allocations, 1);
+    return benchmark_real_realloc(memory, size);
+}
+
+static void SDLCALL benchmark_free(void *memory)
+{
+    benchmark_real_free(memory);
+}
+
+// Start counting SDL's allocations. Call before SDL_Init, nothing can be
+// allocated by SDL yet or it would be freed with the wrong function.
+void benchmark_count_allocations(void)
+{
+    SDL_GetMemoryFunctions(&benchmark_real_malloc, &benchmark_real_calloc, &benchmark_real_realloc, &benchmark_real_free);
+    SDL_SetMemoryFunctions(benchmark_malloc, benchmark_calloc, benchmark_realloc, benchmark_free);
+}
+
+// Call before anything else is set up for the benchmark. Returns false if
+// there's no memory for the frame times.
+bool benchmark_init(Frame_Benchmark *b, int frames)
+{
+    memset(b, 0, sizeof(Frame_Benchmark));
+    b->frames = frames;
+    b->times = malloc((size_t)frames * sizeof(double));
+    b->allocations = malloc((size_t)frames * sizeof(int));
+    b->frequency = SDL_GetPerformanceFrequency();
+
+    return b->times && b->allocations;
+}
+
+void benchmark_free_frames(Frame_Benchmark *b)
+{
+    free(b->times);
+    free(b->allocations);
+}
+
+static void benchmark_press(SDL_Keycode key)
+{
+    SDL_Event event = {0};
+    event.type = SDL_KEYDOWN;
+    event.key.state = SDL_PRESSED;
+    event.key.keysym.sym = key;
+    SDL_PushEvent(&event);
+}
+
+// Top of the frame: let the bot pick this tick's input and send it as key presses.
+void benchmark_frame_begin(Frame_Benchmark *b, Game *g)
+{
+    b->frame_start = SDL_GetPerformanceCounter();
+    if (b->count == 0) b->start = b->frame_start;
+    b->frame_allocations = SDL_AtomicGet(&benchmark_allocations);
+
+    bot_drive(&b->bot, g);
+
+    if (g->do_left_move) benchmark_press(SDLK_LEFT);
+    if (g->do_right_move) benchmark_press(SDLK_RIGHT);
+    if (g->do_drop) benchmark_press(SDLK_UP);
+    if (g->do_rotate_clockwise) benchmark_press(SDLK_x);
+    if (g->do_rotate_counter_clockwise) benchmark_press(SDLK_z);
+
+    g->do_left_move = false;
+    g->do_right_move = false;
+    g->do_drop = false;
+    g->do_rotate_clockwise = false;
+    g->do_rotate_counter_clockwise = false;
+}
+
+// After the present. Returns true once every frame has run.
+bool benchmark_frame_end(Frame_Benchmark *b)
+{
+    b->times[b->count] = (double)(SDL_GetPerformanceCounter() - b->frame_start) / (double)b->frequency;
+    b->allocations[b->count] = SDL_AtomicGet(&benchmark_allocations) - b->frame_allocations;
+    b->count += 1;
+
+    return b->count >= b->frames;
+}
+
+static int benchmark_compare(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double benchmark_percentile(double *sorted, int count, double percent)
+{
+    int i = (int)(count * percent / 100.0);
+    if (i >= count) i = count - 1;
+    return sorted[i] * 1000.0;
+}
+
+void benchmark_report(Frame_Benchmark *b, SDL_Renderer *renderer, Game *g)
+{
+    if (b->count == 0) return;
+
+    double seconds = (double)(SDL_GetPerformanceCounter() - b->start) / (double)b->frequency;
+
+    long long allocations = 0;
+    int most_allocations = 0;
+    for (int i = 0; i < b->count; i += 1)
+    {
+        allocations += b->allocations[i];
+        if (b->allocations[i] > most_allocations) most_allocations = b->allocations[i];
+    }
+
+    qsort(b->times, (size_t)b->count, sizeof(double), benchmark_compare);
+
+    SDL_RendererInfo info = {0};
+    SDL_GetRendererInfo(renderer, &info);
+
+    printf("%d frames on %s, %s renderer, in %.3f s: %.1f frames/s\n",
+           b->count, SDL_GetCurrentVideoDriver(), info.name ? info.name : "unknown", seconds, b->count / seconds);
+    printf("frame ms: p50 %.3f, p90 %.3f, p99 %.3f, p99.9 %.3f, max %.3f\n",
+           benchmark_percentile(b->times, b->count, 50.0), benchmark_percentile(b->times, b->count, 90.0),
+           benchmark_percentile(b->times, b->count, 99.0), benchmark_percentile(b->times, b->count, 99.9),
+           b->times[b->count - 1] * 1000.0);
+    printf("allocations: %.2f a frame, %d at most, %lld in all\n", (double)allocations / b->count, most_allocations, allocations);
+    printf("game: %d lines, %d pieces\n", g->board.score, g->board.pieces);
+}
@@ -0,0 +1,172 @@
+// A simple placement bot. It tries every rotation and column for the active
+// piece, hard drops it on a copy of the board rows and scores the result with
+// a few surface features. Weights are the ones from Yiyuan Lee's write-up.
+
+typedef struct {
+    int rotation;
+    int x;
+} Bot_Move;
+
+typedef struct {
+    Bot_Move move;
+
+    // Which piece the move was planned for, as board->pieces.
+    int piece;
+
+    // Where the active piece was when the last input was sent, so a blocked
+    // move can be noticed and the piece dropped where it is.
+    int last_rotation;
+    int last_x;
+    bool sent_input;
+} Bot;
+
+float bot_evaluate(uint16_t *rows, int lines_cleared)
+{
+    int heights[BOARD_WIDTH];
+    int aggregate_height = 0;
+    int holes = 0;
+
+    for (int column = 0; column < BOARD_WIDTH; column += 1)
+    {
+        uint16_t bit = (uint16_t)(1 << column);
+
+        int row = 0;
+        while (row < BOARD_HEIGHT && !(rows[row] & bit)) row += 1;
+
+        heights[column] = BOARD_HEIGHT - row;
+        aggregate_height += heights[column];
+
+        for (; row < BOARD_HEIGHT; row += 1)
+        {
+            if (!(rows[row] & bit)) holes += 1;
+        }
+    }
+
+    int bumpiness = 0;
+    for (int column = 0; column < BOARD_WIDTH - 1; column += 1)
+    {
+        int difference = heights[column] - heights[column + 1];
+        bumpiness += difference < 0 ? -difference : difference;
+    }
+
+    return -0.510066f * aggregate_height
+           +0.760666f * lines_cleared
+           -0.35663f  * holes
+           -0.184483f * bumpiness;
+}
+
+// Lock a copy of the tetronimo into rows and remove any full rows. Returns how many were removed.
+int bot_place(uint16_t *rows, Tetronimo *t)
+{
+    const uint16_t *shape = get_shape(t);
+
+    for (int j = 0; j < 4; j += 1)
+    {
+        int y = t->y + j;
+        if (!shape[j] || y < 0 || y >= BOARD_HEIGHT) continue;
+
+        uint32_t piece_row = (uint32_t)shape[j] << (t->x + BOARD_PADDING);
+        rows[y] |= (uint16_t)((piece_row >> BOARD_PADDING) & BOARD_FULL_ROW);
+    }
+
+    int lines = 0;
+    int write = BOARD_HEIGHT - 1;
+    for (int read = BOARD_HEIGHT - 1; read >= 0; read -= 1)
+    {
+        if (rows[read] == BOARD_FULL_ROW)
+        {
+            lines += 1;
+            continue;
+        }
+
+        rows[write] = rows[read];
+        write -= 1;
+    }
+
+    for (; write >= 0; write -= 1) rows[write] = 0;
+
+    return lines;
+}
+
+Bot_Move bot_choose_move(Board *b, Tetronimo *active)
+{
+    TRACE_BEGIN(bot_search);
+
+    Bot_Move best = {active->rotation, active->x};
+    float best_score = -1e30f;
+
+    int rotations = active->type == O ? 1 : 4;
+
+    for (int rotation = 0; rotation < rotations; rotation += 1)
+    {
+        for (int x = -BOARD_PADDING + 1; x < BOARD_WIDTH; x += 1)
+        {
+            Tetronimo t = *active;
+            t.rotation = rotation;
+            t.x = x;
+
+            if (collides_at(&t, b, t.x, t.y)) continue;
+            t.y += drop_distance(&t, b);
+
+            uint16_t rows[BOARD_HEIGHT];
+            memcpy(rows, b->rows, sizeof(rows));
+
+            int lines = bot_place(rows, &t);
+            float score = bot_evaluate(rows, lines);
+
+            if (score > best_score)
+            {
+                best_score = score;
+                best.rotation = rotation;
+                best.x = x;
+            }
+        }
+    }
+
+    TRACE_END(bot_search);
+    return best;
+}
+
+// Set one tick's worth of inputs on the game to steer the active piece towards the planned move.
+void bot_drive(Bot *bot, Game *g)
+{
+    Board *b = &g->board;
+    Tetronimo *a = get_active(b);
+    if (!a) return;
+
+    if (bot->piece != b->pieces)
+    {
+        bot->move = bot_choose_move(b, a);
+        bot->piece = b->pieces;
+        bot->sent_input = false;
+    }
+
+    // The last input didn't do anything, so the way is blocked. Drop here.
+    bool stuck = bot->sent_input && a->rotation == bot->last_rotation && a->x == bot->last_x;
+
+    bot->last_rotation = a->rotation;
+    bot->last_x = a->x;
+    bot->sent_input = true;
+
+    if (stuck)
+    {
+        g->do_drop = true;
+    }
+    else if (a->rotation != bot->move.rotation)
+    {
+        if (((a->rotation + 3) & 3) == bot->move.rotation) g->do_rotate_counter_clockwise = true;
+        else g->do_rotate_clockwise = true;
+    }
+    else if (a->x < bot->move.x)
+    {
+        g->do_right_move = true;
+    }
+    else if (a->x > bot->move.x)
+    {
+        g->do_left_move = true;
+    }
+    else
+    {
+        g->do_drop = true;
+    }
+}
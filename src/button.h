@@ -13,7 +13,7 @@ typedef struct {
     SDL_Color text_color;
     SDL_Color color;
 
-    TTF_Font *font;
+    Font *font;
 } Button_Style;
 
 typedef struct {
@@ -43,7 +43,7 @@ typedef struct {
 } Gui;
 
 // Call once in your program.
-void gui_init(Gui *g, TTF_Font *font)
+void gui_init(Gui *g, Font *font)
 {
     g->size = (Button_Size){85, 30};
     g->style = (Button_Style){
@@ -144,13 +144,14 @@ bool do_button(Gui *g, char *text)
     return b._pressed;
 }
 
-void draw_button(SDL_Renderer *renderer, Button button)
+void draw_button(Render_Buffer *r, Button button)
 {
-    SDL_SetRenderDrawColor(renderer, 
-                           (Uint8)(button.style.color.r * 0.7f), 
-                           (Uint8)(button.style.color.g * 0.7f), 
-                           (Uint8)(button.style.color.b * 0.7f), 
-                           (Uint8)(button.style.color.a));
+    render_set_layer(r, Layer_BUTTON_SHADOW);
+    render_set_color(r, 
+                     (Uint8)(button.style.color.r * 0.7f), 
+                     (Uint8)(button.style.color.g * 0.7f), 
+                     (Uint8)(button.style.color.b * 0.7f), 
+                     (Uint8)(button.style.color.a));
 
     SDL_Rect shadow_rect = {
         (int)(button.rect.x + button.rect.w * 0.04f),
@@ -159,38 +160,40 @@ void draw_button(SDL_Renderer *renderer, Button button)
         button.rect.h
     };
 
-    SDL_RenderFillRect(renderer, &shadow_rect);
+    render_fill_rect(r, &shadow_rect);
 
+    render_set_layer(r, Layer_BUTTON);
     if (button._hovered) {
-        SDL_SetRenderDrawColor(renderer, 
-                               (Uint8)(button.style.color.r * 1.5f), 
-                               (Uint8)(button.style.color.g * 1.5f), 
-                               (Uint8)(button.style.color.b * 1.5f), 
-                               (Uint8)(button.style.color.a));
+        render_set_color(r, 
+                         (Uint8)(button.style.color.r * 1.5f), 
+                         (Uint8)(button.style.color.g * 1.5f), 
+                         (Uint8)(button.style.color.b * 1.5f), 
+                         (Uint8)(button.style.color.a));
     } else {
-        SDL_SetRenderDrawColor(renderer, 
-                               button.style.color.r, 
-                               button.style.color.g, 
-                               button.style.color.b, 
-                               button.style.color.a);
+        render_set_color(r, 
+                         button.style.color.r, 
+                         button.style.color.g, 
+                         button.style.color.b, 
+                         button.style.color.a);
     }
 
-    SDL_RenderFillRect(renderer, &button.rect);
-    draw_centered_text(renderer, 
+    render_fill_rect(r, &button.rect);
+
+    render_set_layer(r, Layer_BUTTON_TEXT);
+    draw_centered_text(r, 
               button.rect, 
               button.text,
               button.style.font,
               button.style.text_color);
 }
 
-void draw_all_buttons(SDL_Renderer *renderer, Gui *g)
+void draw_all_buttons(Render_Buffer *r, Gui *g)
 {
     for (int i = 0; i < g->button_count; i += 1)
     {
         Button b = g->buttons_to_render[i];
-        draw_button(renderer, b);
+        draw_button(r, b);
     }
 
     g->button_count = 0;
 }
-
@@ -1,38 +1,146 @@
-void draw_text(SDL_Renderer *renderer, int x, int y, char *string, TTF_Font *font, SDL_Color font_color) {
-    SDL_Surface *surface = TTF_RenderText_Blended(font, string, font_color);
-    SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
-    int x_from_texture, y_from_texture;
-    SDL_QueryTexture(texture, NULL, NULL, &x_from_texture, &y_from_texture);
-    SDL_Rect rect = {x, y, x_from_texture, y_from_texture};
+// Text is drawn from a glyph atlas: every printable ASCII glyph of the font is
+// rasterized once, in white, into one texture. Drawing a string is then one
+// texture copy per glyph from that texture, tinted with the text color.
+#define FONT_FIRST_GLYPH  32
+#define FONT_GLYPH_COUNT  95
+#define FONT_ATLAS_WIDTH  512
 
-    SDL_RenderCopy(renderer, texture, NULL, &rect);
+typedef struct {
+    // Where the glyph is in the atlas.
+    SDL_Rect source;
 
-    SDL_FreeSurface(surface);
-    SDL_DestroyTexture(texture);
+    // From the pen position to the left edge of source, and from there to the next pen position.
+    int offset_x;
+    int advance;
+} Glyph;
+
+typedef struct {
+    SDL_Texture *atlas;
+    Glyph glyphs[FONT_GLYPH_COUNT];
+    int height;
+} Font;
+
+// Build the atlas for a font. Call once, after the renderer exists.
+bool font_init(Font *font, SDL_Renderer *renderer, TTF_Font *ttf)
+{
+    SDL_Surface *surfaces[FONT_GLYPH_COUNT];
+    SDL_Color white = {255, 255, 255, 255};
+
+    font->height = TTF_FontHeight(ttf);
+
+    // Render every glyph and shelf-pack them into rows.
+    TRACE_BEGIN(rasterize_glyphs);
+    int x = 0;
+    int y = 0;
+    int row_height = 0;
+
+    for (int i = 0; i < FONT_GLYPH_COUNT; i += 1)
+    {
+        Uint16 ch = (Uint16)(FONT_FIRST_GLYPH + i);
+        Glyph *glyph = &font->glyphs[i];
+
+        int min_x, max_x, min_y, max_y, advance;
+        TTF_GlyphMetrics(ttf, ch, &min_x, &max_x, &min_y, &max_y, &advance);
+        glyph->advance = advance;
+        glyph->offset_x = min_x < 0 ? min_x : 0;
+
+        surfaces[i] = TTF_RenderGlyph_Blended(ttf, ch, white);
+        int w = surfaces[i] ? surfaces[i]->w : 0;
+        int h = surfaces[i] ? surfaces[i]->h : 0;
+
+        if (x + w > FONT_ATLAS_WIDTH)
+        {
+            x = 0;
+            y += row_height + 1;
+            row_height = 0;
+        }
+
+        glyph->source = (SDL_Rect){x, y, w, h};
+        x += w + 1;
+        if (h > row_height) row_height = h;
+    }
+
+    TRACE_END(rasterize_glyphs);
+
+    SDL_Surface *atlas = SDL_CreateRGBSurfaceWithFormat(0, FONT_ATLAS_WIDTH, y + row_height, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (atlas) SDL_FillRect(atlas, NULL, 0);
+
+    for (int i = 0; i < FONT_GLYPH_COUNT; i += 1)
+    {
+        if (!surfaces[i]) continue;
+
+        if (atlas)
+        {
+            // Copy the alpha as is instead of blending it onto the empty atlas.
+            SDL_SetSurfaceBlendMode(surfaces[i], SDL_BLENDMODE_NONE);
+            SDL_BlitSurface(surfaces[i], NULL, atlas, &font->glyphs[i].source);
+        }
+
+        SDL_FreeSurface(surfaces[i]);
+    }
+
+    if (!atlas) return false;
+
+    font->atlas = SDL_CreateTextureFromSurface(renderer, atlas);
+    SDL_FreeSurface(atlas);
+
+    if (!font->atlas) return false;
+
+    SDL_SetTextureBlendMode(font->atlas, SDL_BLENDMODE_BLEND);
+    return true;
 }
 
-void draw_centered_text(SDL_Renderer *renderer, SDL_Rect rect, char *string, TTF_Font *font, SDL_Color font_color)
+void font_free(Font *font)
 {
-    SDL_Surface *surface = TTF_RenderText_Blended(font, string, font_color);
-    SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
+    SDL_DestroyTexture(font->atlas);
+    font->atlas = NULL;
+}
 
-    int w_from_texture, h_from_texture;
-    SDL_QueryTexture(texture, NULL, NULL, &w_from_texture, &h_from_texture);
+static inline Glyph *font_glyph(Font *font, char c)
+{
+    int i = (unsigned char)c - FONT_FIRST_GLYPH;
+    if (i < 0 || i >= FONT_GLYPH_COUNT) i = '?' - FONT_FIRST_GLYPH;
+    return &font->glyphs[i];
+}
 
-    SDL_Rect draw_rect = {
-        rect.x + rect.w/2 - w_from_texture/2, 
-        rect.y + rect.h/2 - h_from_texture/2, 
-        w_from_texture, 
-        h_from_texture
-    };
+// Width and height of a string, without drawing it.
+SDL_Point measure_text(Font *font, char *string)
+{
+    int width = 0;
+    for (char *c = string; *c; c += 1)
+    {
+        width += font_glyph(font, *c)->advance;
+    }
 
-    SDL_RenderCopy(renderer, texture, NULL, &draw_rect);
+    return (SDL_Point){width, font->height};
+}
 
-    SDL_FreeSurface(surface);
-    SDL_DestroyTexture(texture);
+// Draws with the text color, which is left as the buffer's current color.
+void draw_text(Render_Buffer *r, int x, int y, char *string, Font *font, SDL_Color font_color)
+{
+    render_set_color(r, font_color.r, font_color.g, font_color.b, font_color.a);
+
+    for (char *c = string; *c; c += 1)
+    {
+        Glyph *glyph = font_glyph(font, *c);
+
+        if (glyph->source.w > 0)
+        {
+            SDL_Rect rect = {x + glyph->offset_x, y, glyph->source.w, glyph->source.h};
+            render_copy(r, font->atlas, &glyph->source, &rect);
+        }
+
+        x += glyph->advance;
+    }
+}
+
+void draw_centered_text(Render_Buffer *r, SDL_Rect rect, char *string, Font *font, SDL_Color font_color)
+{
+    SDL_Point size = measure_text(font, string);
+    draw_text(r, rect.x + rect.w/2 - size.x/2, rect.y + rect.h/2 - size.y/2, string, font, font_color);
 }
 
-void draw_circle(SDL_Renderer *renderer, int32_t centreX, int32_t centreY, int32_t radius)
+void draw_circle(Render_Buffer *r, int32_t centreX, int32_t centreY, int32_t radius)
 {
    const int32_t diameter = (radius * 2);
 
@@ -45,14 +153,14 @@ void draw_circle(SDL_Renderer *renderer, int32_t centreX, int32_t centreY, int32
    while (x >= y)
    {
       //  Each of the following renders an octant of the circle
-      SDL_RenderDrawPoint(renderer, centreX + x, centreY - y);
-      SDL_RenderDrawPoint(renderer, centreX + x, centreY + y);
-      SDL_RenderDrawPoint(renderer, centreX - x, centreY - y);
-      SDL_RenderDrawPoint(renderer, centreX - x, centreY + y);
-      SDL_RenderDrawPoint(renderer, centreX + y, centreY - x);
-      SDL_RenderDrawPoint(renderer, centreX + y, centreY + x);
-      SDL_RenderDrawPoint(renderer, centreX - y, centreY - x);
-      SDL_RenderDrawPoint(renderer, centreX - y, centreY + x);
+      render_point(r, centreX + x, centreY - y);
+      render_point(r, centreX + x, centreY + y);
+      render_point(r, centreX - x, centreY - y);
+      render_point(r, centreX - x, centreY + y);
+      render_point(r, centreX + y, centreY - x);
+      render_point(r, centreX + y, centreY + x);
+      render_point(r, centreX - y, centreY - x);
+      render_point(r, centreX - y, centreY + x);
 
       if (error <= 0)
       {
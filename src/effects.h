@@ -0,0 +1,212 @@
+// Particles for line clears, hard drops and topping out, driven by the
+// game's event queue. Positions are in board cells, so they don't care where
+// the board is drawn.
+//
+// Particles live in a fixed pool kept as separate arrays per field, packed
+// at the front: a dead one is replaced by the last live one. Updates run over
+// the arrays four particles at a time with vec2x4. Nothing allocates after
+// effects_init, and when the pool is full new particles are just not made.
+// Headless builds don't include this at all.
+
+// A multiple of 4, so four-at-a-time updates never read past the end.
+#define EFFECTS_MAX_PARTICLES 8192
+
+// In cells a second, and cells a second squared.
+#define EFFECTS_GRAVITY       40.0f
+
+// Particles per cell of a filled row, so a four row clear makes 2560.
+#define EFFECTS_LINE_PARTICLES 64
+
+typedef struct {
+    float *x;
+    float *y;
+    float *vx;
+    float *vy;
+
+    // Seconds left to live, and seconds it started with.
+    float *life;
+    float *lifetime;
+
+    Color *color;
+
+    int count;
+    int capacity;
+
+    // Visual only, so it doesn't matter that it isn't the game's randomizer.
+    Random random;
+} Effects;
+
+size_t effects_memory_size(void)
+{
+    return EFFECTS_MAX_PARTICLES * (6 * sizeof(float) + sizeof(Color)) + 7 * 16;
+}
+
+// The arena needs effects_memory_size bytes free.
+bool effects_init(Effects *e, Arena *arena)
+{
+    size_t floats = EFFECTS_MAX_PARTICLES * sizeof(float);
+
+    e->x        = arena_alloc_aligned(arena, floats, 16);
+    e->y        = arena_alloc_aligned(arena, floats, 16);
+    e->vx       = arena_alloc_aligned(arena, floats, 16);
+    e->vy       = arena_alloc_aligned(arena, floats, 16);
+    e->life     = arena_alloc_aligned(arena, floats, 16);
+    e->lifetime = arena_alloc_aligned(arena, floats, 16);
+    e->color    = arena_alloc_aligned(arena, EFFECTS_MAX_PARTICLES * sizeof(Color), 16);
+
+    e->count = 0;
+    e->capacity = EFFECTS_MAX_PARTICLES;
+    random_seed(&e->random, 1);
+
+    return e->x && e->y && e->vx && e->vy && e->life && e->lifetime && e->color;
+}
+
+static inline float effects_random(Effects *e, float low, float high)
+{
+    return low + (high - low) * (float)(random_next(&e->random) >> 8) * (1.0f / 16777216.0f);
+}
+
+static void effects_spawn(Effects *e, float x, float y, float vx, float vy, float life, Color color)
+{
+    if (e->count == e->capacity) return;
+
+    int i = e->count++;
+    e->x[i] = x;
+    e->y[i] = y;
+    e->vx[i] = vx;
+    e->vy[i] = vy;
+    e->life[i] = life;
+    e->lifetime[i] = life;
+    e->color[i] = color;
+}
+
+static void effects_line_clear(Effects *e, Board *b, uint32_t rows)
+{
+    for (int row = 0; row < b->height; row += 1)
+    {
+        if (!(rows & (1u << row))) continue;
+
+        for (int column = 0; column < b->width; column += 1)
+        {
+            Color color = get_color((Tetronimo_Type)b->cell_types[get_2d_index(column, row, b->width)]);
+
+            for (int k = 0; k < EFFECTS_LINE_PARTICLES; k += 1)
+            {
+                effects_spawn(e,
+                              (float)column + effects_random(e, 0.0f, 1.0f),
+                              (float)row + effects_random(e, 0.0f, 1.0f),
+                              effects_random(e, -8.0f, 8.0f),
+                              effects_random(e, -14.0f, -2.0f),
+                              effects_random(e, 0.4f, 1.0f),
+                              k & 3 ? color : (Color){255, 255, 255, 255});
+            }
+        }
+    }
+}
+
+// A streak down the columns the piece fell through, and dust where it landed.
+static void effects_hard_drop(Effects *e, Tetronimo *t, int from_y)
+{
+    const uint16_t *shape = get_shape(t);
+    Color color = get_color(t->type);
+
+    for (int i = 0; i < 4; i += 1)
+    {
+        int bottom = -1;
+        for (int j = 0; j < 4; j += 1)
+        {
+            if (shape[j] & (1 << i)) bottom = j;
+        }
+        if (bottom < 0) continue;
+
+        float column = (float)(t->x + i);
+
+        for (int row = from_y + bottom; row < t->y + bottom; row += 1)
+        {
+            for (int k = 0; k < 3; k += 1)
+            {
+                effects_spawn(e, column + effects_random(e, 0.2f, 0.8f), (float)row + effects_random(e, 0.0f, 1.0f),
+                              0.0f, effects_random(e, -2.0f, 0.0f), effects_random(e, 0.1f, 0.3f), color);
+            }
+        }
+
+        for (int k = 0; k < 6; k += 1)
+        {
+            effects_spawn(e, column + effects_random(e, 0.0f, 1.0f), (float)(t->y + bottom + 1),
+                          effects_random(e, -4.0f, 4.0f), effects_random(e, -6.0f, -1.0f), effects_random(e, 0.2f, 0.5f),
+                          (Color){200, 200, 200, 255});
+        }
+    }
+}
+
+// Everything on the board bursts.
+static void effects_top_out(Effects *e, Board *b)
+{
+    for (int row = 0; row < b->height; row += 1)
+    {
+        for (int column = 0; column < b->width; column += 1)
+        {
+            if (!(b->rows[row] & (1 << column))) continue;
+
+            Color color = get_color((Tetronimo_Type)b->cell_types[get_2d_index(column, row, b->width)]);
+
+            for (int k = 0; k < 4; k += 1)
+            {
+                effects_spawn(e, (float)column + 0.5f, (float)row + 0.5f,
+                              effects_random(e, -12.0f, 12.0f), effects_random(e, -20.0f, 0.0f),
+                              effects_random(e, 0.6f, 1.5f), color);
+            }
+        }
+    }
+}
+
+// Make particles for one of the game's events. b is the board as of the
+// event, or near enough: line clears and top outs take their colors from it.
+void effects_add_event(Effects *e, Board *b, Game_Event *event)
+{
+    switch (event->kind)
+    {
+        case Event_LINES:     effects_line_clear(e, b, event->rows); break;
+        case Event_HARD_DROP: effects_hard_drop(e, &event->piece, event->from_y); break;
+        case Event_TOP_OUT:   effects_top_out(e, b); break;
+    }
+}
+
+void effects_update(Effects *e, float dt)
+{
+    vec2x4 gravity = vec2x4_make(0.0f, EFFECTS_GRAVITY * dt);
+
+    for (int i = 0; i < e->count; i += 4)
+    {
+        vec2x4 velocity = vec2x4_add(vec2x4_load(&e->vx[i], &e->vy[i]), gravity);
+        vec2x4 position = vec2x4_add(vec2x4_load(&e->x[i], &e->y[i]), vec2x4_scalar_multiply(velocity, dt));
+
+        vec2x4_store(velocity, &e->vx[i], &e->vy[i]);
+        vec2x4_store(position, &e->x[i], &e->y[i]);
+    }
+
+    for (int i = 0; i < e->count; i += 1)
+    {
+        e->life[i] -= dt;
+    }
+
+    // Swap the dead out from the back.
+    int i = 0;
+    while (i < e->count)
+    {
+        if (e->life[i] > 0.0f)
+        {
+            i += 1;
+            continue;
+        }
+
+        int last = --e->count;
+        e->x[i] = e->x[last];
+        e->y[i] = e->y[last];
+        e->vx[i] = e->vx[last];
+        e->vy[i] = e->vy[last];
+        e->life[i] = e->life[last];
+        e->lifetime[i] = e->lifetime[last];
+        e->color[i] = e->color[last];
+    }
+}
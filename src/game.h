@@ -0,0 +1,753 @@
+// The rules of the game: board, pieces, rotation and the per-frame update.
+// Nothing in here touches SDL, so it can run headless. Times are in microseconds.
+
+#define TICK_TIME (650 * 1000)
+
+// How long full rows show before they're removed, unless the game sets its own clear_time.
+#define CLEAR_TIME (300 * 1000)
+
+// Only the active tetronimo is ever alive. Locked ones turn into cells and go
+// straight back to the pool.
+#define MAX_TETRONIMOS 4
+
+#define BOARD_WIDTH  10
+#define BOARD_HEIGHT 20
+
+// Board rows are bitmasks, bit 0 is the leftmost column. For collision tests
+// a row is widened to 32 bits with BOARD_PADDING wall bits on either side, so
+// a piece row shifted past the edge of the board hits a wall bit.
+#define BOARD_PADDING  4
+#define BOARD_FULL_ROW ((uint16_t)((1 << BOARD_WIDTH) - 1))
+#define BOARD_WALLS    (~((uint32_t)BOARD_FULL_ROW << BOARD_PADDING))
+
+typedef enum {
+    I = 1,
+    O,
+    T,
+    J,
+    L,
+    S,
+    Z,
+    DOT,
+} Tetronimo_Type;
+
+typedef struct {
+    int id;
+    Tetronimo_Type type;
+    bool grounded;
+    bool deleted;
+
+    int x;
+    int y;
+
+    // SRS orientation: 0 is the spawn state, then R, 2 and L going clockwise.
+    int rotation;
+} Tetronimo;
+
+typedef struct {
+    Pool tetronimos;
+
+    // Occupancy of the locked cells, one bitmask per row.
+    uint16_t rows[BOARD_HEIGHT];
+
+    // Tetronimo_Type of each locked cell, only meaningful where rows has a bit set.
+    uint8_t cell_types[BOARD_HEIGHT*BOARD_WIDTH];
+
+    // Rows that are full and waiting to be removed on the next tick.
+    uint32_t rows_to_clear;
+
+    // Goes up whenever the locked cells change or change color, so renderers can cache them.
+    uint32_t revision;
+
+    // Row of the highest locked cell in each column, height if the column is
+    // empty. Kept up to date on lock and clear, so drops don't have to search.
+    int8_t column_top[BOARD_WIDTH];
+
+    Handle active;
+
+    // Where the active tetronimo would land, worked out at the end of each update.
+    int ghost_y;
+
+    // Where the pieces come from, see random.h.
+    Randomizer randomizer;
+
+    int width;
+    int height;
+
+    bool check_for_clear;
+    int score;
+
+    // Pieces spawned this game.
+    int pieces;
+} Board;
+
+// Things that happened during game_update, for effects to react to. The game
+// never reads them back.
+#define MAX_GAME_EVENTS 16
+
+typedef enum {
+    Event_HARD_DROP,
+    Event_LINES,
+    Event_TOP_OUT,
+} Game_Event_Kind;
+
+typedef struct {
+    Game_Event_Kind kind;
+
+    // Hard drop: the piece where it landed, and the row it fell from.
+    // Top out: the piece that didn't fit.
+    Tetronimo piece;
+    int from_y;
+
+    // Lines: the rows that just filled up.
+    uint32_t rows;
+} Game_Event;
+
+typedef struct {
+    Board board;
+
+    bool do_left_move;
+    bool do_right_move;
+    bool do_down_move;
+    bool do_drop;
+    bool do_rotate_clockwise;
+    bool do_rotate_counter_clockwise;
+
+    uint64_t turn_timer;
+    uint64_t timer;
+    int turn_count;
+
+    // Events since whoever reads them last set event_count to 0. Once it's
+    // full, new ones are dropped, so nothing has to read them (headless doesn't).
+    Game_Event events[MAX_GAME_EVENTS];
+    int event_count;
+
+    // Full rows show for clear_time before they're removed, and nothing else
+    // happens meanwhile. clear_timer is how long they've been showing.
+    uint64_t clear_time;
+    uint64_t clear_timer;
+
+    // Set when the game tops out (or the player asks for it). The next
+    // game_update starts a fresh game.
+    bool reset;
+
+    // The next reset deals pieces from this seed, so the same seed and the
+    // same inputs always play the same game. preview is how many upcoming
+    // pieces are known.
+    uint64_t seed;
+    int preview;
+} Game;
+
+typedef struct {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+    uint8_t a;
+} Color;
+
+Color get_color(Tetronimo_Type type)
+{
+    Color c;
+
+    switch (type)
+    {
+        case I:   c = (Color){0,   255, 255, 255}; break;
+        case O:   c = (Color){255, 255, 0,   255}; break;
+        case T:   c = (Color){128, 0,   128, 255}; break;
+        case J:   c = (Color){0,   0,   255, 255}; break;
+        case L:   c = (Color){255, 165, 0,   255}; break;
+        case S:   c = (Color){0,   255, 0,   255}; break;
+        case Z:   c = (Color){255, 0,   0,   255}; break;
+        default:
+        case DOT: c = (Color){35,  35,  35,  255}; break;
+    }
+
+    return c;
+}
+
+// One 4x4 row mask per orientation, bit 0 is the leftmost column of the box.
+// Orientations follow the SRS guideline, so the spawn states and kicks line up
+// with the tables below.
+#define SHAPE_ROW(a, b, c, d) ((uint16_t)((a) | ((b) << 1) | ((c) << 2) | ((d) << 3)))
+
+static const uint16_t piece_shapes[DOT+1][4][4] = {
+    [I] = {
+        { SHAPE_ROW(0,0,0,0), SHAPE_ROW(1,1,1,1), SHAPE_ROW(0,0,0,0), SHAPE_ROW(0,0,0,0) },
+        { SHAPE_ROW(0,0,1,0), SHAPE_ROW(0,0,1,0), SHAPE_ROW(0,0,1,0), SHAPE_ROW(0,0,1,0) },
+        { SHAPE_ROW(0,0,0,0), SHAPE_ROW(0,0,0,0), SHAPE_ROW(1,1,1,1), SHAPE_ROW(0,0,0,0) },
+        { SHAPE_ROW(0,1,0,0), SHAPE_ROW(0,1,0,0), SHAPE_ROW(0,1,0,0), SHAPE_ROW(0,1,0,0) },
+    },
+    [O] = {
+        { SHAPE_ROW(0,1,1,0), SHAPE_ROW(0,1,1,0), 0, 0 },
+        { SHAPE_ROW(0,1,1,0), SHAPE_ROW(0,1,1,0), 0, 0 },
+        { SHAPE_ROW(0,1,1,0), SHAPE_ROW(0,1,1,0), 0, 0 },
+        { SHAPE_ROW(0,1,1,0), SHAPE_ROW(0,1,1,0), 0, 0 },
+    },
+    [T] = {
+        { SHAPE_ROW(0,1,0,0), SHAPE_ROW(1,1,1,0), SHAPE_ROW(0,0,0,0), 0 },
+        { SHAPE_ROW(0,1,0,0), SHAPE_ROW(0,1,1,0), SHAPE_ROW(0,1,0,0), 0 },
+        { SHAPE_ROW(0,0,0,0), SHAPE_ROW(1,1,1,0), SHAPE_ROW(0,1,0,0), 0 },
+        { SHAPE_ROW(0,1,0,0), SHAPE_ROW(1,1,0,0), SHAPE_ROW(0,1,0,0), 0 },
+    },
+    [J] = {
+        { SHAPE_ROW(1,0,0,0), SHAPE_ROW(1,1,1,0), SHAPE_ROW(0,0,0,0), 0 },
+        { SHAPE_ROW(0,1,1,0), SHAPE_ROW(0,1,0,0), SHAPE_ROW(0,1,0,0), 0 },
+        { SHAPE_ROW(0,0,0,0), SHAPE_ROW(1,1,1,0), SHAPE_ROW(0,0,1,0), 0 },
+        { SHAPE_ROW(0,1,0,0), SHAPE_ROW(0,1,0,0), SHAPE_ROW(1,1,0,0), 0 },
+    },
+    [L] = {
+        { SHAPE_ROW(0,0,1,0), SHAPE_ROW(1,1,1,0), SHAPE_ROW(0,0,0,0), 0 },
+        { SHAPE_ROW(0,1,0,0), SHAPE_ROW(0,1,0,0), SHAPE_ROW(0,1,1,0), 0 },
+        { SHAPE_ROW(0,0,0,0), SHAPE_ROW(1,1,1,0), SHAPE_ROW(1,0,0,0), 0 },
+        { SHAPE_ROW(1,1,0,0), SHAPE_ROW(0,1,0,0), SHAPE_ROW(0,1,0,0), 0 },
+    },
+    [S] = {
+        { SHAPE_ROW(0,1,1,0), SHAPE_ROW(1,1,0,0), SHAPE_ROW(0,0,0,0), 0 },
+        { SHAPE_ROW(0,1,0,0), SHAPE_ROW(0,1,1,0), SHAPE_ROW(0,0,1,0), 0 },
+        { SHAPE_ROW(0,0,0,0), SHAPE_ROW(0,1,1,0), SHAPE_ROW(1,1,0,0), 0 },
+        { SHAPE_ROW(1,0,0,0), SHAPE_ROW(1,1,0,0), SHAPE_ROW(0,1,0,0), 0 },
+    },
+    [Z] = {
+        { SHAPE_ROW(1,1,0,0), SHAPE_ROW(0,1,1,0), SHAPE_ROW(0,0,0,0), 0 },
+        { SHAPE_ROW(0,0,1,0), SHAPE_ROW(0,1,1,0), SHAPE_ROW(0,1,0,0), 0 },
+        { SHAPE_ROW(0,0,0,0), SHAPE_ROW(1,1,0,0), SHAPE_ROW(0,1,1,0), 0 },
+        { SHAPE_ROW(0,1,0,0), SHAPE_ROW(1,1,0,0), SHAPE_ROW(1,0,0,0), 0 },
+    },
+    [DOT] = {
+        { 0, SHAPE_ROW(0,1,0,0), 0, 0 },
+        { 0, SHAPE_ROW(0,1,0,0), 0, 0 },
+        { 0, SHAPE_ROW(0,1,0,0), 0, 0 },
+        { 0, SHAPE_ROW(0,1,0,0), 0, 0 },
+    },
+};
+
+typedef enum {
+    Rotate_CLOCKWISE,
+    Rotate_COUNTER_CLOCKWISE,
+} Rotate_Direction;
+
+typedef struct {
+    int x;
+    int y;
+} Kick;
+
+// SRS wall kicks, indexed by [starting orientation][direction][test].
+// Offsets are written as in the guideline with y pointing up, so they are
+// negated when applied to the board.
+static const Kick kicks_jlstz[4][2][5] = {
+    { { {0,0}, {-1,0}, {-1, 1}, {0,-2}, {-1,-2} },     // 0 -> R
+      { {0,0}, { 1,0}, { 1, 1}, {0,-2}, { 1,-2} } },   // 0 -> L
+    { { {0,0}, { 1,0}, { 1,-1}, {0, 2}, { 1, 2} },     // R -> 2
+      { {0,0}, { 1,0}, { 1,-1}, {0, 2}, { 1, 2} } },   // R -> 0
+    { { {0,0}, { 1,0}, { 1, 1}, {0,-2}, { 1,-2} },     // 2 -> L
+      { {0,0}, {-1,0}, {-1, 1}, {0,-2}, {-1,-2} } },   // 2 -> R
+    { { {0,0}, {-1,0}, {-1,-1}, {0, 2}, {-1, 2} },     // L -> 0
+      { {0,0}, {-1,0}, {-1,-1}, {0, 2}, {-1, 2} } },   // L -> 2
+};
+
+static const Kick kicks_i[4][2][5] = {
+    { { {0,0}, {-2,0}, { 1,0}, {-2,-1}, { 1, 2} },     // 0 -> R
+      { {0,0}, {-1,0}, { 2,0}, {-1, 2}, { 2,-1} } },   // 0 -> L
+    { { {0,0}, {-1,0}, { 2,0}, {-1, 2}, { 2,-1} },     // R -> 2
+      { {0,0}, { 2,0}, {-1,0}, { 2, 1}, {-1,-2} } },   // R -> 0
+    { { {0,0}, { 2,0}, {-1,0}, { 2, 1}, {-1,-2} },     // 2 -> L
+      { {0,0}, { 1,0}, {-2,0}, { 1,-2}, {-2, 1} } },   // 2 -> R
+    { { {0,0}, { 1,0}, {-2,0}, { 1,-2}, {-2, 1} },     // L -> 0
+      { {0,0}, {-2,0}, { 1,0}, {-2,-1}, { 1, 2} } },   // L -> 2
+};
+
+static inline const uint16_t *get_shape(Tetronimo *t)
+{
+    return piece_shapes[t->type][t->rotation];
+}
+
+Tetronimo make_tetronimo(Tetronimo_Type type, int x, int y)
+{
+    Tetronimo t;
+
+    t.type = type;
+
+    t.rotation = 0;
+    t.x = x;
+    t.y = y;
+    t.grounded = false;
+    t.deleted = false;
+
+    return t;
+}
+
+int get_2d_index(int w, int h, int width)
+{
+    return(h*width + w);
+}
+
+
+// Piece rows that fall outside the board are solid below the floor and empty above the top.
+bool collides_at(Tetronimo *a, Board *b, int x, int y)
+{
+    if (x < -BOARD_PADDING) return true;
+
+    for (int j = 0; j < 4; j += 1)
+    {
+        uint32_t piece_row = get_shape(a)[j];
+        if (!piece_row) continue;
+
+        int row = y + j;
+        if (row >= b->height) return true;
+
+        uint32_t board_row = BOARD_WALLS;
+        if (row >= 0) board_row |= (uint32_t)b->rows[row] << BOARD_PADDING;
+
+        if ((piece_row << (x + BOARD_PADDING)) & board_row) return true;
+    }
+
+    return false;
+}
+
+bool solid_below(Tetronimo *tetronimo, Board *board)
+{
+    return collides_at(tetronimo, board, tetronimo->x, tetronimo->y + 1);
+}
+
+// The slow way, one row at a time.
+int drop_distance_search(Tetronimo *tetronimo, Board *board)
+{
+    int distance = 0;
+    while (!collides_at(tetronimo, board, tetronimo->x, tetronimo->y + distance + 1))
+    {
+        distance += 1;
+    }
+
+    return distance;
+}
+
+// How many rows the tetronimo can fall before it lands. Each column of the
+// piece can fall until its lowest cell sits on top of that column, unless the
+// piece is tucked under an overhang, where the tops don't say anything and
+// the rows have to be searched.
+int drop_distance(Tetronimo *tetronimo, Board *board)
+{
+    const uint16_t *shape = get_shape(tetronimo);
+    int distance = board->height;
+
+    for (int i = 0; i < 4; i += 1)
+    {
+        int bottom = -1;
+        for (int j = 3; j >= 0; j -= 1)
+        {
+            if (shape[j] & (1 << i))
+            {
+                bottom = j;
+                break;
+            }
+        }
+
+        if (bottom < 0) continue;
+
+        int column = tetronimo->x + i;
+        int lowest = tetronimo->y + bottom;
+        if (lowest >= board->column_top[column]) return drop_distance_search(tetronimo, board);
+
+        int fall = board->column_top[column] - lowest - 1;
+        if (fall < distance) distance = fall;
+    }
+
+    return distance;
+}
+
+// Recompute column_top from the rows, after rows have been removed.
+void update_column_tops(Board *board)
+{
+    uint16_t seen = 0;
+
+    for (int x = 0; x < board->width; x += 1)
+    {
+        board->column_top[x] = (int8_t)board->height;
+    }
+
+    for (int y = 0; y < board->height && seen != BOARD_FULL_ROW; y += 1)
+    {
+        uint16_t fresh = board->rows[y] & ~seen;
+        if (!fresh) continue;
+
+        seen |= fresh;
+        for (int x = 0; x < board->width; x += 1)
+        {
+            if (fresh & (1 << x)) board->column_top[x] = (int8_t)y;
+        }
+    }
+}
+
+void transform_to_tetrons(Tetronimo *tetronimo, Board *board)
+{
+    for (int j = 0; j < 4; j += 1)
+    {
+        int y = tetronimo->y + j;
+        if (y < 0 || y >= board->height) continue;
+
+        uint32_t piece_row = get_shape(tetronimo)[j];
+        if (!piece_row) continue;
+
+        uint16_t row = (uint16_t)(((piece_row << (tetronimo->x + BOARD_PADDING)) >> BOARD_PADDING) & BOARD_FULL_ROW);
+        board->rows[y] |= row;
+        board->revision += 1;
+
+        for (int x = 0; x < board->width; x += 1)
+        {
+            if (!(row & (1 << x))) continue;
+
+            board->cell_types[get_2d_index(x, y, board->width)] = (uint8_t)tetronimo->type;
+            if (y < board->column_top[x]) board->column_top[x] = (int8_t)y;
+        }
+    }
+}
+
+bool collides_with_wall(Tetronimo *a, Board *b)
+{
+    (void)b;
+    if (a->x < -BOARD_PADDING) return true;
+
+    for (int j = 0; j < 4; j += 1)
+    {
+        uint32_t piece_row = get_shape(a)[j];
+        if ((piece_row << (a->x + BOARD_PADDING)) & BOARD_WALLS) return true;
+    }
+
+    return false;
+}
+
+// Locked cells and the floor. Columns outside the board are left to collides_with_wall.
+bool collides_with_cells(Tetronimo *a, Board *b)
+{
+    if (a->x < -BOARD_PADDING) return false;
+
+    for (int j = 0; j < 4; j += 1)
+    {
+        uint32_t piece_row = get_shape(a)[j];
+        if (!piece_row) continue;
+
+        int row = a->y + j;
+        if (row >= b->height) return true;
+        if (row < 0) continue;
+
+        if ((piece_row << (a->x + BOARD_PADDING)) & ((uint32_t)b->rows[row] << BOARD_PADDING)) return true;
+    }
+
+    return false;
+}
+
+// Rotate using the SRS kick tests. Returns false and leaves the tetronimo alone if every test collides.
+bool rotate_tetronimo(Tetronimo *a, Board *b, Rotate_Direction direction)
+{
+    if (a->type == O) return true;
+
+    int from = a->rotation;
+    int to = (direction == Rotate_CLOCKWISE) ? (from + 1) & 3 : (from + 3) & 3;
+
+    const Kick *kicks = (a->type == I) ? kicks_i[from][direction] : kicks_jlstz[from][direction];
+
+    a->rotation = to;
+    for (int test = 0; test < 5; test += 1)
+    {
+        int x = a->x + kicks[test].x;
+        int y = a->y - kicks[test].y;
+
+        if (!collides_at(a, b, x, y))
+        {
+            a->x = x;
+            a->y = y;
+            return true;
+        }
+    }
+
+    a->rotation = from;
+    return false;
+}
+
+// Length in microseconds of tick number tick, when running at rate ticks a second.
+// Rounded so that every second's worth of ticks adds up to exactly one second.
+uint64_t game_tick_dt(int rate, uint64_t tick)
+{
+    return (tick + 1) * 1000000 / (uint64_t)rate - tick * 1000000 / (uint64_t)rate;
+}
+
+size_t game_memory_size(void)
+{
+    return pool_memory_size(MAX_TETRONIMOS, sizeof(Tetronimo));
+}
+
+// Call once before the first game_reset. The arena needs game_memory_size bytes free.
+void game_init(Game *g, Arena *arena)
+{
+    pool_init(&g->board.tetronimos, arena, MAX_TETRONIMOS, sizeof(Tetronimo));
+}
+
+static inline Tetronimo *get_active(Board *b)
+{
+    return pool_get(&b->tetronimos, b->active);
+}
+
+// Turn the active tetronimo into cells and give it back to the pool.
+void lock_active(Board *b)
+{
+    TRACE_INSTANT(lock, b->pieces);
+    transform_to_tetrons(get_active(b), b);
+    pool_release(&b->tetronimos, b->active);
+
+    b->active = 0;
+    b->check_for_clear = true;
+}
+
+void game_reset(Game *g)
+{
+    Board *b = &g->board;
+
+    b->width = BOARD_WIDTH;
+    b->height = BOARD_HEIGHT;
+    pool_clear(&b->tetronimos);
+
+    b->active = 0;
+    b->ghost_y = 0;
+    b->check_for_clear = false;
+    b->rows_to_clear = 0;
+    b->score = 0;
+    b->pieces = 0;
+
+    randomizer_init(&b->randomizer, g->seed, g->preview);
+
+    memset(b->rows, 0, sizeof(b->rows));
+    memset(b->cell_types, 0, sizeof(b->cell_types));
+    update_column_tops(b);
+    b->revision += 1;
+
+    // Inputs are left alone. When game_update does the reset they're for the
+    // new game's first tick, and a replay has them recorded there.
+
+    g->timer = 0;
+    g->turn_timer = 0;
+    g->turn_count = 0;
+    g->clear_timer = 0;
+    g->event_count = 0;
+
+    g->reset = false;
+}
+
+static void push_event(Game *g, Game_Event_Kind kind, Tetronimo *piece, int from_y, uint32_t rows)
+{
+    if (g->event_count == MAX_GAME_EVENTS) return;
+
+    Game_Event *e = &g->events[g->event_count++];
+    e->kind = kind;
+    e->piece = piece ? *piece : (Tetronimo){0};
+    e->from_y = from_y;
+    e->rows = rows;
+}
+
+// How far through the line clear the game is, from 0 to 1.
+float clear_progress(Game *g)
+{
+    if (!g->board.rows_to_clear || g->clear_time == 0) return 0.0f;
+    return (float)g->clear_timer / (float)g->clear_time;
+}
+
+// Full rows that aren't already waiting to be cleared, one bit per row.
+uint32_t find_full_rows(Board *b)
+{
+    uint32_t filled = 0;
+    for (int row = 0; row < b->height; row += 1)
+    {
+        if (b->rows[row] == BOARD_FULL_ROW) filled |= 1u << row;
+    }
+
+    return filled & ~b->rows_to_clear;
+}
+
+// Remove the full rows and move the rest down, in one pass from the bottom up.
+void clear_rows(Board *b)
+{
+    TRACE_BEGIN(clear_rows);
+
+    int write = b->height - 1;
+    for (int read = b->height - 1; read >= 0; read -= 1)
+    {
+        if (b->rows_to_clear & (1u << read)) continue;
+
+        if (write != read)
+        {
+            b->rows[write] = b->rows[read];
+            memcpy(&b->cell_types[get_2d_index(0, write, b->width)],
+                   &b->cell_types[get_2d_index(0, read, b->width)],
+                   (size_t)b->width);
+        }
+
+        write -= 1;
+    }
+
+    for (; write >= 0; write -= 1)
+    {
+        b->rows[write] = 0;
+    }
+
+    b->rows_to_clear = 0;
+    b->revision += 1;
+    update_column_tops(b);
+
+    TRACE_END(clear_rows);
+}
+
+void game_update(Game *g, uint64_t dt)
+{
+    Board *b = &g->board;
+
+    if (g->reset)
+    {
+        game_reset(g);
+    }
+
+    // Line clear: full rows show for exactly clear_time, then go. Until then
+    // nothing spawns or falls, and inputs are thrown away.
+    if (b->rows_to_clear)
+    {
+        g->timer += dt;
+        g->clear_timer += dt;
+
+        if (g->clear_timer < g->clear_time)
+        {
+            g->do_drop                     = false;
+            g->do_left_move                = false;
+            g->do_right_move               = false;
+            g->do_down_move                = false;
+            g->do_rotate_clockwise         = false;
+            g->do_rotate_counter_clockwise = false;
+            return;
+        }
+
+        clear_rows(b);
+        g->clear_timer = 0;
+        dt = 0;
+    }
+
+    if (!b->active)
+    {
+        // Spawn a tetronimo.
+        b->active = pool_acquire(&b->tetronimos);
+
+        Tetronimo *t = get_active(b);
+        *t = make_tetronimo((Tetronimo_Type)randomizer_next(&b->randomizer), (b->width/2)-2, 0);
+        b->pieces += 1;
+
+        if (collides_with_cells(t, b))
+        {
+            push_event(g, Event_TOP_OUT, t, t->y, 0);
+            g->reset = true;
+        }
+    }
+
+    // Handle inputs on the active tetronimo.
+    if (b->active)
+    {
+        Tetronimo *a = get_active(b);
+
+        if (g->do_left_move)
+        {
+            a->x -= 1;
+            if (collides_with_wall(a, b) || collides_with_cells(a, b))
+            {
+                a->x += 1;
+            }
+
+            g->do_left_move = false;
+        }
+
+        if (g->do_right_move)
+        {
+            a->x += 1;
+            if (collides_with_wall(a, b) || collides_with_cells(a, b))
+            {
+                a->x -= 1;
+            }
+
+            g->do_right_move = false;
+        }
+
+        if (g->do_down_move)
+        {
+            g->turn_timer = TICK_TIME;
+            g->do_down_move = false;
+        }
+
+        if (g->do_drop)
+        {
+            int from_y = a->y;
+            a->y += drop_distance(a, b);
+            push_event(g, Event_HARD_DROP, a, from_y, 0);
+            lock_active(b);
+
+            g->turn_timer = TICK_TIME;
+
+            // The piece is gone, so there's nothing left to rotate this tick.
+            g->do_drop = false;
+            g->do_rotate_clockwise = false;
+            g->do_rotate_counter_clockwise = false;
+        }
+
+        if (g->do_rotate_clockwise)
+        {
+            rotate_tetronimo(a, b, Rotate_CLOCKWISE);
+            g->do_rotate_clockwise = false;
+        }
+
+        if (g->do_rotate_counter_clockwise)
+        {
+            rotate_tetronimo(a, b, Rotate_COUNTER_CLOCKWISE);
+            g->do_rotate_counter_clockwise = false;
+        }
+    }
+
+    g->turn_timer += dt;
+    g->timer += dt;
+
+    if (g->turn_timer >= TICK_TIME)
+    {
+        // Keep the leftover so gravity stays on time. One step per call, so
+        // dt has to stay well under TICK_TIME (see the fixed timestep in main.c).
+        g->turn_timer -= TICK_TIME;
+        if (g->turn_timer >= TICK_TIME) g->turn_timer = 0;
+        g->turn_count += 1;
+
+        // Timer ran out, move the active tetronimo.
+        Tetronimo *a = get_active(b);
+        if (a)
+        {
+            if (solid_below(a, b)) {
+                lock_active(b);
+            } else {
+                a->y += 1;
+            }
+        }
+
+    }
+
+    if (b->check_for_clear)
+    {
+        // Filled rows get drawn white until the line clear is over.
+        uint32_t filled = find_full_rows(b);
+
+        if (filled)
+        {
+            for (uint32_t rows = filled; rows; rows &= rows - 1) b->score += 1;
+
+            b->rows_to_clear |= filled;
+            b->revision += 1;
+            push_event(g, Event_LINES, NULL, 0, filled);
+            TRACE_INSTANT(line_clear, filled);
+        }
+
+        b->check_for_clear = false;
+    }
+
+    Tetronimo *a = get_active(b);
+    if (a) b->ghost_y = a->y + drop_distance(a, b);
+
+    return;
+}
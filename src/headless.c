@@ -0,0 +1,533 @@
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+
+#include "arena.h"
+#include "platform.h"
+#include "trace.h"
+#include "pool.h"
+#include "random.h"
+#include "game.h"
+#include "replay.h"
+#include "raster.h"
+#include "terminal.h"
+#include "bot.h"
+#include "batch.h"
+#include "runner.h"
+
+// Each call to game_update stands in for one 60 Hz frame.
+#define HEADLESS_RATE 60
+
+typedef struct {
+    int games;
+    int max_pieces;
+    uint64_t seed;
+    uint64_t clear_time;
+    char *script_path;
+    char *record_path;
+    char *replay_path;
+    char *frames_path;
+    char *thumbnail_path;
+    int frame_every;
+    int cell_size;
+    bool terminal;
+    bool quiet;
+    int threads;
+    char *trace_path;
+
+    int batch;
+    int steps;
+    char *actions;
+} Options;
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t cursor;
+} Script;
+
+void print_usage(void)
+{
+    printf("Usage: tetris_headless [options]\n");
+    printf("  --games N        Number of games to play (default 1).\n");
+    printf("  --max-pieces N   End a game after N pieces, 0 for no limit (default 1000).\n");
+    printf("  --seed N         Seed for the piece sequences, game i uses N + i (default: time).\n");
+    printf("  --clear-time MS  How long full rows show before they go (default %d).\n", CLEAR_TIME / 1000);
+    printf("  --script FILE    Play inputs from FILE instead of the bot, one per tick:\n");
+    printf("                   L R D (move), U (drop), X Z (rotate), . (nothing).\n");
+    printf("  --record FILE    Save the --script game as a replay.\n");
+    printf("  --replay FILE    Play a replay back as fast as possible and print its result.\n");
+    printf("  --frames DIR     With --replay, write an image of the board to DIR every\n");
+    printf("                   --frame-every ticks (default 1).\n");
+    printf("  --thumbnail FILE With --replay, write an image of the final board.\n");
+    printf("  --cell N         Cell size in pixels for images (default 16).\n");
+    printf("                   Images are PPM if the name ends in .ppm, PNG otherwise.\n");
+    printf("  --terminal       Watch the game in the terminal in real time: the bot's games\n");
+    printf("                   one after another, or the --replay.\n");
+    printf("  --quiet          Only print the totals.\n");
+    printf("  --threads N      Worker threads for bot games, 0 for one per core (default 1).\n");
+    printf("  --trace FILE     Record a timeline of games, bot searches, locks and line\n");
+    printf("                   clears on every thread as a Chrome trace (JSON).\n");
+    printf("  --batch N        Benchmark stepping N boards in lockstep.\n");
+    printf("  --steps N        Steps to run with --batch (default 10000).\n");
+    printf("  --actions MIX    Actions for --batch: random (default), drops (each board\n");
+    printf("                   drops every 8 steps and does nothing otherwise) or none.\n");
+}
+
+bool parse_options(Options *options, int argc, char *argv[])
+{
+    options->games = 1;
+    options->max_pieces = 1000;
+    options->seed = (uint64_t)time(0);
+    options->clear_time = CLEAR_TIME;
+    options->script_path = NULL;
+    options->record_path = NULL;
+    options->replay_path = NULL;
+    options->frames_path = NULL;
+    options->thumbnail_path = NULL;
+    options->frame_every = 1;
+    options->cell_size = 16;
+    options->terminal = false;
+    options->quiet = false;
+    options->threads = 1;
+    options->trace_path = NULL;
+    options->batch = 0;
+    options->steps = 10000;
+    options->actions = "random";
+
+    for (int i = 1; i < argc; i += 1)
+    {
+        char *arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (!strcmp(arg, "--games") && has_value) options->games = atoi(argv[++i]);
+        else if (!strcmp(arg, "--max-pieces") && has_value) options->max_pieces = atoi(argv[++i]);
+        else if (!strcmp(arg, "--seed") && has_value) options->seed = strtoull(argv[++i], NULL, 10);
+        else if (!strcmp(arg, "--clear-time") && has_value) options->clear_time = strtoull(argv[++i], NULL, 10) * 1000;
+        else if (!strcmp(arg, "--script") && has_value) options->script_path = argv[++i];
+        else if (!strcmp(arg, "--record") && has_value) options->record_path = argv[++i];
+        else if (!strcmp(arg, "--replay") && has_value) options->replay_path = argv[++i];
+        else if (!strcmp(arg, "--frames") && has_value) options->frames_path = argv[++i];
+        else if (!strcmp(arg, "--frame-every") && has_value) options->frame_every = atoi(argv[++i]);
+        else if (!strcmp(arg, "--thumbnail") && has_value) options->thumbnail_path = argv[++i];
+        else if (!strcmp(arg, "--cell") && has_value) options->cell_size = atoi(argv[++i]);
+        else if (!strcmp(arg, "--terminal")) options->terminal = true;
+        else if (!strcmp(arg, "--quiet")) options->quiet = true;
+        else if (!strcmp(arg, "--threads") && has_value) options->threads = atoi(argv[++i]);
+        else if (!strcmp(arg, "--trace") && has_value) options->trace_path = argv[++i];
+        else if (!strcmp(arg, "--batch") && has_value) options->batch = atoi(argv[++i]);
+        else if (!strcmp(arg, "--steps") && has_value) options->steps = atoi(argv[++i]);
+        else if (!strcmp(arg, "--actions") && has_value) options->actions = argv[++i];
+        else return false;
+    }
+
+    if (strcmp(options->actions, "random") && strcmp(options->actions, "drops") && strcmp(options->actions, "none")) return false;
+
+    return true;
+}
+
+bool load_script(Script *script, char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) return false;
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    script->data = malloc((size_t)length + 1);
+    script->length = fread(script->data, 1, (size_t)length, file);
+    script->cursor = 0;
+
+    fclose(file);
+    return true;
+}
+
+// Apply the next scripted input. Returns false once the script runs out.
+bool script_drive(Script *script, Game *g)
+{
+    while (script->cursor < script->length)
+    {
+        char c = script->data[script->cursor++];
+
+        switch (c)
+        {
+            case 'L': g->do_left_move = true; return true;
+            case 'R': g->do_right_move = true; return true;
+            case 'D': g->do_down_move = true; return true;
+            case 'U': g->do_drop = true; return true;
+            case 'X': g->do_rotate_clockwise = true; return true;
+            case 'Z': g->do_rotate_counter_clockwise = true; return true;
+            case '.': return true;
+            default: break;
+        }
+    }
+
+    return false;
+}
+
+// Wait until the given tick is due, for a game started at start running at rate ticks a second.
+void wait_for_tick(uint64_t start, int rate, long long tick)
+{
+    uint64_t due = start + (uint64_t)tick * 1000000 / (uint64_t)rate;
+    uint64_t now = time_now_us();
+    if (due > now) sleep_us(due - now);
+}
+
+int run_script(Options *options)
+{
+    Script script = {0};
+    if (!load_script(&script, options->script_path))
+    {
+        printf("Error: couldn't open script %s\n", options->script_path);
+        return 1;
+    }
+
+    static Game game;
+    long long ticks = 0;
+
+    void *memory = malloc(game_memory_size());
+    Arena arena;
+    arena_init(&arena, memory, game_memory_size());
+    game_init(&game, &arena);
+
+    game.seed = options->seed;
+    game.preview = 1;
+    game.clear_time = options->clear_time;
+    game_reset(&game);
+
+    Replay replay = {0};
+    replay_begin(&replay, &game, HEADLESS_RATE);
+
+    while (!game.reset && game.board.pieces < options->max_pieces)
+    {
+        if (!script_drive(&script, &game)) break;
+
+        replay_record(&replay, &game);
+        game_update(&game, game_tick_dt(HEADLESS_RATE, (uint64_t)ticks));
+        ticks += 1;
+    }
+
+    printf("score %d, pieces %d, ticks %lld\n", game.board.score, game.board.pieces, ticks);
+
+    int result = 0;
+    if (options->record_path)
+    {
+        replay_end(&replay);
+        if (!replay_save(&replay, options->record_path))
+        {
+            printf("Error: couldn't write replay %s\n", options->record_path);
+            result = 1;
+        }
+    }
+
+    replay_free(&replay);
+    free(memory);
+    free(script.data);
+    return result;
+}
+
+int run_replay(Options *options)
+{
+    Replay replay = {0};
+    if (!replay_load(&replay, options->replay_path))
+    {
+        printf("Error: couldn't read replay %s\n", options->replay_path);
+        replay_free(&replay);
+        return 1;
+    }
+
+    static Game game;
+    game.preview = 1;
+
+    void *memory = malloc(game_memory_size());
+    Arena arena;
+    arena_init(&arena, memory, game_memory_size());
+    game_init(&game, &arena);
+
+    Replay_Player player;
+    replay_player_init(&player, &replay, &game);
+
+    bool drawing = options->frames_path || options->thumbnail_path;
+    if (options->frame_every < 1) options->frame_every = 1;
+    if (options->cell_size < 1) options->cell_size = 1;
+
+    Image image = {0};
+    if (drawing)
+    {
+        raster_frame_size(options->cell_size, &image.width, &image.height);
+        image.pixels = malloc((size_t)image.width * (size_t)image.height * sizeof(uint32_t));
+    }
+
+    long long ticks = 0;
+    long long frames = 0;
+    uint64_t raster_us = 0;
+    uint64_t start = time_now_us();
+    int result = 0;
+
+    static Terminal terminal;
+    if (options->terminal) terminal_begin(&terminal);
+
+    while (replay_play(&player, &game))
+    {
+        game_update(&game, game_tick_dt(replay.rate, (uint64_t)ticks));
+        ticks += 1;
+
+        if (options->terminal)
+        {
+            terminal_draw_game(&terminal, &game);
+            wait_for_tick(start, replay.rate, ticks);
+        }
+
+        if (options->frames_path && ticks % options->frame_every == 0)
+        {
+            uint64_t raster_start = time_now_us();
+            raster_game(&image, &game, options->cell_size);
+            raster_us += time_now_us() - raster_start;
+            frames += 1;
+
+            char path[1024];
+            snprintf(path, sizeof(path), "%s/frame_%06lld.png", options->frames_path, frames - 1);
+            if (!image_write(&image, path))
+            {
+                printf("Error: couldn't write %s\n", path);
+                result = 1;
+                break;
+            }
+        }
+    }
+
+    if (options->thumbnail_path && !result)
+    {
+        raster_game(&image, &game, options->cell_size);
+        if (!image_write(&image, options->thumbnail_path))
+        {
+            printf("Error: couldn't write %s\n", options->thumbnail_path);
+            result = 1;
+        }
+    }
+
+    if (options->terminal) terminal_end(&terminal);
+
+    double seconds = (double)(time_now_us() - start) / 1e6;
+    if (seconds <= 0.0) seconds = 1e-9;
+
+    printf("seed %llu, score %d, pieces %d, ticks %lld in %.3f s (%.0f ticks/s)\n",
+           (unsigned long long)replay.seed, game.board.score, game.board.pieces, ticks, seconds, ticks / seconds);
+
+    if (options->terminal)
+    {
+        printf("%lld terminal frames, %lld bytes (%.1f bytes/frame)\n",
+               terminal.frames, terminal.bytes, terminal.frames ? (double)terminal.bytes / (double)terminal.frames : 0.0);
+    }
+
+    if (frames > 0)
+    {
+        double raster_seconds = raster_us > 0 ? (double)raster_us / 1e6 : 1e-9;
+        printf("%lld frames drawn in %.3f s (%.0f frames/s, not counting writing them)\n", frames, raster_seconds, frames / raster_seconds);
+    }
+
+    free(image.pixels);
+    free(memory);
+    replay_free(&replay);
+    return result;
+}
+
+// Play bot games one after another in real time, drawn in the terminal.
+int run_watch(Options *options)
+{
+    static Game game;
+    static Bot bot;
+    static Terminal terminal;
+
+    void *memory = malloc(game_memory_size());
+    Arena arena;
+    arena_init(&arena, memory, game_memory_size());
+    game_init(&game, &arena);
+
+    terminal_begin(&terminal);
+
+    for (int i = 0; i < options->games; i += 1)
+    {
+        memset(&bot, 0, sizeof(Bot));
+        game.seed = options->seed + (uint64_t)i;
+        game.preview = 1;
+        game.clear_time = options->clear_time;
+        game_reset(&game);
+
+        long long ticks = 0;
+        uint64_t start = time_now_us();
+
+        while (!game.reset && game.board.pieces < options->max_pieces)
+        {
+            bot_drive(&bot, &game);
+            game_update(&game, game_tick_dt(HEADLESS_RATE, (uint64_t)ticks));
+            ticks += 1;
+
+            terminal_draw_game(&terminal, &game);
+            wait_for_tick(start, HEADLESS_RATE, ticks);
+        }
+    }
+
+    terminal_end(&terminal);
+    printf("%lld terminal frames, %lld bytes (%.1f bytes/frame)\n",
+           terminal.frames, terminal.bytes, terminal.frames ? (double)terminal.bytes / (double)terminal.frames : 0.0);
+
+    free(memory);
+    return 0;
+}
+
+int run_batch_benchmark(Options *options)
+{
+    size_t memory_size = batch_memory_size(options->batch);
+    void *memory = malloc(memory_size);
+
+    Arena arena;
+    arena_init(&arena, memory, memory_size);
+
+    Batch batch;
+    batch_init(&batch, &arena, options->batch, options->seed);
+
+    // Pre-roll a few sets of actions so the timing is all batch_step. Random
+    // drops are weighted down a bit so pieces get to move around first. With
+    // drops, each board drops every 8 steps, staggered so every step has some.
+    #define ACTION_SETS 16
+    uint8_t *actions = malloc((size_t)options->batch * ACTION_SETS);
+    uint32_t x = (uint32_t)options->seed | 1;
+    for (int i = 0; i < options->batch * ACTION_SETS; i += 1)
+    {
+        if (!strcmp(options->actions, "none"))
+        {
+            actions[i] = Action_NONE;
+        }
+        else if (!strcmp(options->actions, "drops"))
+        {
+            int set = i / options->batch;
+            int board = i % options->batch;
+            actions[i] = (set + board) % 8 == 0 ? Action_DROP : Action_NONE;
+        }
+        else
+        {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            actions[i] = (uint8_t)(x % (Action_COUNT + 2));
+            if (actions[i] >= Action_COUNT) actions[i] = Action_NONE;
+        }
+    }
+
+    clock_t start = clock();
+
+    for (int step = 0; step < options->steps; step += 1)
+    {
+        batch_step(&batch, &actions[(size_t)(step % ACTION_SETS) * (size_t)options->batch]);
+    }
+
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    if (seconds <= 0.0) seconds = 1e-9;
+
+    printf("%d boards x %d steps, %s actions: %lld board-steps, %lld pieces, %lld lines, %lld games in %.3f s\n",
+           options->batch, options->steps, options->actions, batch.steps, batch.pieces, batch.total_lines, batch.games, seconds);
+    printf("%.1f M board-steps/s, %.0f ns per board-step\n",
+           batch.steps / seconds / 1e6, seconds * 1e9 / (double)batch.steps);
+
+    free(actions);
+    free(memory);
+    return 0;
+}
+
+// The bot games, on the runner's threads.
+int run_games(Options *options)
+{
+    Game_Result *results = calloc((size_t)options->games, sizeof(Game_Result));
+
+    size_t memory_size = 64 * 1024;
+    void *memory = malloc(memory_size);
+    Arena arena;
+    arena_init(&arena, memory, memory_size);
+
+    Runner runner = {0};
+    runner.max_pieces = options->max_pieces;
+    runner.rate = HEADLESS_RATE;
+    runner.clear_time = options->clear_time;
+    runner.seed = options->seed;
+
+    uint64_t start = time_now_us();
+    runner_run(&runner, &arena, options->threads, options->games, results);
+    double seconds = (double)(time_now_us() - start) / 1e6;
+    if (seconds <= 0.0) seconds = 1e-9;
+
+    long long total_pieces = 0;
+    long long total_lines = 0;
+    long long total_ticks = 0;
+    long long total_steals = 0;
+
+    for (int i = 0; i < runner.worker_count; i += 1)
+    {
+        Worker *w = &runner.workers[i].worker;
+        total_pieces += w->pieces;
+        total_lines += w->lines;
+        total_ticks += w->ticks;
+        total_steals += w->steals;
+    }
+
+    if (!options->quiet)
+    {
+        for (int i = 0; i < options->games; i += 1)
+        {
+            printf("game %d: score %d, pieces %d, ticks %lld\n", i, results[i].score, results[i].pieces, results[i].ticks);
+        }
+    }
+
+    printf("%d games on %d threads (%lld steals), %lld pieces, %lld lines, %lld ticks in %.3f s (%.0f pieces/s, %.0f ticks/s)\n",
+           options->games, runner.worker_count, total_steals, total_pieces, total_lines, total_ticks, seconds,
+           total_pieces / seconds, total_ticks / seconds);
+
+    free(memory);
+    free(results);
+    return 0;
+}
+
+int run(Options *options)
+{
+    if (options->batch > 0) return run_batch_benchmark(options);
+
+    if (options->max_pieces <= 0) options->max_pieces = INT_MAX;
+
+    if (options->replay_path) return run_replay(options);
+    if (options->script_path) return run_script(options);
+
+    if (options->games < 1) return 0;
+    if (options->terminal) return run_watch(options);
+
+    return run_games(options);
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!parse_options(&options, argc, argv))
+    {
+        print_usage();
+        return 1;
+    }
+
+    if (options.trace_path && !trace_start(options.trace_path))
+    {
+        fprintf(stderr, "Can't write %s\n", options.trace_path);
+        return 1;
+    }
+    trace_thread_name("main");
+
+    int result = run(&options);
+
+    trace_stop();
+    return result;
+}
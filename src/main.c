@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <time.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "SDL.h"
@@ -10,91 +11,110 @@
 #include "SDL_image.h"
 
 #include "vec2.h"
+#include "arena.h"
+#include "pool.h"
+#include "platform.h"
+#include "trace.h"
+#include "render.h"
 #include "draw.h"
 #include "button.h"
-
-#define TICK_TIME 650
+#include "random.h"
+#include "game.h"
+#include "replay.h"
+#include "bot.h"
+#include "terminal.h"
+#include "spectate.h"
+#include "effects.h"
+#include "triple_buffer.h"
+#include "profile.h"
+#include "benchmark.h"
 
 #define DEBUG_PRINT(_a, _b) do {                                               \
-        sprintf(buf, _a, _b);                                                  \
-        draw_text(renderer, 0, y, buf, font, (SDL_Color){255, 255, 255, 255}); \
+        sprintf_s(buf, 50, _a, _b);                                            \
+        draw_text(r, 0, y, buf, font, (SDL_Color){255, 255, 255, 255});        \
         y += 15;                                                               \
     } while (0)
 
-typedef enum {
-    I = 1,
-    O,
-    T,
-    J,
-    L,
-    S,
-    Z,
-    DOT,
-} Tetronimo_Type;
-
-typedef struct {
-    int width;
-    int height;
-    vec2 pivot;
-    bool cells[16];
-} BoundingBox;
-
 typedef struct {
-    int id;
-    Tetronimo_Type type;
-    bool grounded;
-    bool deleted;
+    int x;
+    int y;
+} Window;
 
-    vec2 position;
-    float rotation;
-    SDL_Color color;
+typedef enum {
+    Screen_MENU,
+    Screen_GAME,
+} Screen;
 
-    BoundingBox bounding_box;
-} Tetronimo;
+// The simulation runs in fixed ticks of 1/rate seconds, however long frames
+// take. Frame time goes into the accumulator (in performance counter ticks
+// times rate, so a simulation tick is exactly frequency of them) and whole
+// ticks are taken out. After a long hitch only SIM_MAX_CATCH_UP ms are made
+// up, the rest is dropped.
+#define SIM_DEFAULT_RATE 120
+#define SIM_MIN_RATE     10
+#define SIM_MAX_RATE     1000
+#define SIM_MAX_CATCH_UP 250
 
 typedef struct {
-    int id;
-    SDL_Color color;
-    bool marked_for_delete;
+    int rate;
 
-    bool exists;
+    Uint64 frequency;
+    Uint64 last_counter;
+    Uint64 accumulator;
 
-    vec2 position;
-} Tetron;
-
-typedef struct {
-    Tetronimo entities[1000];
-    int entity_count;
+    // Ticks run this game, so tick lengths in microseconds add up exactly and
+    // every game sees the same ones (replays depend on it).
+    Uint64 ticks;
+} Sim_Clock;
 
-    Tetron cells[20*10];
-    int cell_count;
-
-    Tetronimo *active;
-    Tetronimo *ghost;
-    Tetronimo_Type next;
+// Frame pacing. Presents wait for vblank, so when they return is when the
+// frame went up. With --low-latency the next vblank is predicted from those
+// times and the frame sleeps until just before it, so input is read and the
+// game updated as late as possible. Latency is measured either way, from
+// reading input to the present returning.
+#define PACER_MARGIN 0.001
 
+typedef struct {
+    bool enabled;
+    Uint64 frequency;
+
+    // Seconds between vblanks, and how long a frame takes from waking up to
+    // being ready to present, both measured.
+    double period;
+    double work;
+
+    Uint64 last_present;
+    Uint64 wake;
+    Uint64 rendered;
+
+    // Seconds from reading input to the present returning, the last frame and smoothed.
+    double latency;
+    double average_latency;
+} Frame_Pacer;
+
+// The active piece at one moment, for drawing it between ticks. y includes
+// how far gravity has got towards the next row, so a falling piece slides
+// down smoothly instead of jumping a cell at a time.
+typedef struct {
+    Handle handle;
+    int rotation;
+    float x;
+    float y;
+} Piece_Snapshot;
+
+// The board background and locked cells, drawn into a texture and only
+// redrawn when the board's revision changes.
+typedef struct {
+    SDL_Texture *texture;
     int width;
     int height;
 
-    SDL_Rect rect;
-    float cell_size;
-
-    SDL_Rect pause_menu_rect;
-
-    bool check_for_clear;
-    bool there_are_rows_to_be_cleared;
-    int score;
-} Board;
+    uint32_t revision;
+    bool valid;
+} Board_Cache;
 
-typedef struct {
-    int x;
-    int y;
-} Window;
-
-typedef enum {
-    Screen_MENU,
-    Screen_GAME,
-} Screen;
+// Enough for every tick of a long frame to drop a piece and clear a line.
+#define SNAPSHOT_EVENTS 64
 
 typedef struct {
     Window window;
@@ -107,273 +127,357 @@ typedef struct {
         bool clicked;
     } mouse;
 
-    Board board;
+    Game game;
+    Sim_Clock clock;
 
-    bool do_left_move;
-    bool do_right_move;
-    bool do_down_move;
-    bool do_drop;
-    bool do_rotate_clockwise;
-    bool do_rotate_counter_clockwise;
+    bool show_debug;
+    bool show_profile;
 
-    Uint64 turn_timer;
-    Uint64 timer;
-    int turn_count;
+    // The active piece before the last tick, and how far the clock is towards
+    // the next one. Frames draw the piece part way between the two.
+    Piece_Snapshot previous_piece;
+    float tick_alpha;
+
+    // Every game is recorded and saved as a replay when it ends. With --replay
+    // a saved game is played back instead of taking input.
+    Replay recording;
+    Replay playback;
+    Replay_Player player;
+    bool playing;
+
+    // Games are seeded from the clock, unless a seed was given with --seed.
+    bool fixed_seed;
+
+    // Off for --benchmark, so it doesn't leave replays behind.
+    bool save_replays;
+
+    // Where the board sits in the window, worked out when a game starts.
+    SDL_Rect board_rect;
+    float cell_size;
+
+    SDL_Rect pause_menu_rect;
+
+    // The game's events, numbered from the first one. Only the last
+    // SNAPSHOT_EVENTS are kept, for renderers to make particles from.
+    Game_Event events[SNAPSHOT_EVENTS];
+    uint64_t event_count;
+
+    // Goes up when the renderer loses its textures.
+    int render_resets;
 
     int score_history;
     Uint64 timer_history;
 
     Gui gui;
 
-    bool reset;
     bool quit;
 } State;
 
-SDL_Color get_color(Tetronimo_Type type)
-{
-    SDL_Color c;
+// Everything a frame draws, copied out of State after the frame's ticks. The
+// render functions only look at a snapshot, never at State, so with
+// --render-thread the simulation can go on while the last frame is drawn.
+typedef struct {
+    Screen screen;
+    bool paused;
+    bool show_debug;
+    bool show_profile;
+    Window window;
 
-    switch (type)
-    {
-        case I:   c = (SDL_Color){0,   255, 255, 255}; break;
-        case O:   c = (SDL_Color){255, 255, 0,   255}; break;
-        case T:   c = (SDL_Color){128, 0,   128, 255}; break;
-        case J:   c = (SDL_Color){0,   0,   255, 255}; break;
-        case L:   c = (SDL_Color){255, 165, 0,   255}; break;
-        case S:   c = (SDL_Color){0,   255, 0,   255}; break;
-        case Z:   c = (SDL_Color){255, 0,   0,   255}; break;
-        default:
-        case DOT: c = (SDL_Color){35,  35,  35,  255}; break;
-    }
+    // The board without its pieces, which are only pointers into the game's
+    // pool. The active piece is copied out on its own.
+    Board board;
+    int tetronimo_count;
 
-    return c;
-}
+    bool has_piece;
+    Tetronimo piece;
+    Piece_Snapshot piece_before;
+    Piece_Snapshot piece_now;
+    float tick_alpha;
+    float clear_progress;
+
+    Uint64 timer;
+    int score_history;
+    Uint64 timer_history;
+
+    SDL_Rect board_rect;
+    float cell_size;
+    SDL_Rect pause_menu_rect;
+
+    Button buttons[50];
+    int button_count;
 
-Tetronimo make_tetronimo(Tetronimo_Type type, vec2 position)
+    Game_Event events[SNAPSHOT_EVENTS];
+    uint64_t event_count;
+    int render_resets;
+} Render_Snapshot;
+
+// What rendering owns: the renderer, everything made with it, and the
+// particles, which are only there to be looked at. With --render-thread all
+// of it belongs to the render thread.
+typedef struct {
+    SDL_Window *window;
+    SDL_Renderer *renderer;
+    Font font;
+    Render_Buffer buffer;
+    Board_Cache board_cache;
+    Frame_Pacer pacer;
+
+    // Particles, in board cells.
+    Effects effects;
+
+    // How far through the snapshots' events and renderer resets this has got.
+    uint64_t events_seen;
+    int render_resets;
+
+    Uint64 last_frame;
+
+    // Why render_context_init failed.
+    const char *error_title;
+    char error[256];
+} Render_Context;
+
+// Simulation to render thread. The render thread draws the newest snapshot
+// and presents, and the main thread never waits for it.
+typedef struct {
+    Render_Context *context;
+    SDL_Window *window;
+    TTF_Font *ttf;
+    Arena *arena;
+    int capacity;
+
+    Render_Snapshot *snapshots;
+    Triple_Buffer buffer;
+
+    // The thread posts ready once the renderer is made, or failed to be (then ok is false).
+    SDL_sem *ready;
+    bool ok;
+
+    SDL_atomic_t quit;
+} Render_Thread;
+
+SDL_Color get_sdl_color(Tetronimo_Type type)
 {
-    Tetronimo t;
+    Color c = get_color(type);
+    return (SDL_Color){c.r, c.g, c.b, c.a};
+}
 
-    t.type = type;
+Piece_Snapshot snapshot_piece(Game *g)
+{
+    Board *b = &g->board;
+    Piece_Snapshot snapshot = {b->active, 0, 0.0f, 0.0f};
 
-    t.color = get_color(t.type);
-    t.rotation = 0.0f;
-    t.position = position;
-    t.grounded = false;
-    t.deleted = false;
+    Tetronimo *t = get_active(b);
+    if (!t) return snapshot;
 
-    BoundingBox box;
-    switch (t.type)
-    {
-        case I: {
-            box.width = 4;
-            box.height = 4;
-            box.pivot = vec2_make(2.0f, 2.0f);
-            bool cells[16] = {
-                0, 0, 0, 0, 
-                1, 1, 1, 1, 
-                0, 0, 0, 0, 
-                0, 0, 0, 0
-            };
+    snapshot.rotation = t->rotation;
+    snapshot.x = (float)t->x;
+    snapshot.y = (float)t->y;
 
-            memcpy(box.cells, cells, sizeof(bool) * 16);
-        } break;
+    // A resting piece doesn't sink into what's under it.
+    if (b->ghost_y > t->y) snapshot.y += (float)g->turn_timer / (float)TICK_TIME;
 
-        case O: {
-            box.width = 4;
-            box.height = 3;
-            box.pivot = vec2_make(2.0f, 1.0f);
-            bool cells[16] = {
-                0, 1, 1, 0, 
-                0, 1, 1, 0, 
-                0, 0, 0, 0, 
-            };
+    return snapshot;
+}
 
-            memcpy(box.cells, cells, sizeof(bool) * 16);
-        } break;
+// The board background and the locked cells, with the board's top left at origin.
+// Rows being cleared are left out, they change every frame (see draw_clearing_rows).
+void draw_board_cells(Render_Buffer *r, Render_Snapshot *s, int origin_x, int origin_y)
+{
+    render_set_layer(r, Layer_BOARD);
+    render_set_color(r, 35, 35, 35, 255);
+    SDL_Rect board_rect = {origin_x, origin_y, s->board_rect.w, s->board_rect.h};
+    render_fill_rect(r, &board_rect);
 
-        case T: {
-            box.width = 3;
-            box.height = 3;
-            box.pivot = vec2_make(1.5f, 1.5f);
-            bool cells[16] = {
-                0, 1, 0,
-                1, 1, 1,
-                0, 0, 0,
-            };
+    float cell_padding = 0.02f;
+    float cell_padding_abs = cell_padding * s->cell_size;
 
-            memcpy(box.cells, cells, sizeof(bool) * 16);
-        } break;
+    render_set_layer(r, Layer_CELLS);
+    for (int row = 0; row < s->board.height; row += 1)
+    {
+        uint16_t bits = s->board.rows[row];
+        if (!bits || (s->board.rows_to_clear & (1u << row))) continue;
 
-        case J: {
-            box.width = 3;
-            box.height = 3;
-            box.pivot = vec2_make(1.5f, 1.5f);
-            bool cells[16] = {
-                0, 1, 0,
-                0, 1, 0,
-                1, 1, 0,
-            };
+        for (int column = 0; column < s->board.width; column += 1)
+        {
+            if (!(bits & (1 << column))) continue;
 
-            memcpy(box.cells, cells, sizeof(bool) * 16);
-        } break;
+            SDL_Color color = get_sdl_color((Tetronimo_Type)s->board.cell_types[get_2d_index(column, row, s->board.width)]);
 
-        case L: {
-            box.width = 3;
-            box.height = 3;
-            box.pivot = vec2_make(1.5f, 1.5f);
-            bool cells[16] = {
-                0, 1, 0,
-                0, 1, 0,
-                0, 1, 1,
+            SDL_Rect rect = (SDL_Rect){
+                (int)(origin_x + (column * s->cell_size)),
+                (int)(origin_y + (row * s->cell_size)),
+                (int)(s->cell_size),
+                (int)(s->cell_size),
             };
 
-            memcpy(box.cells, cells, sizeof(bool) * 16);
-        } break;
+            rect.x += (int)(cell_padding_abs);
+            rect.y += (int)(cell_padding_abs);
+            rect.w -= (int)(2*cell_padding_abs);
+            rect.h -= (int)(2*cell_padding_abs);
 
-        case S: {
-            box.width = 3;
-            box.height = 3;
-            box.pivot = vec2_make(1.5f, 1.5f);
-            bool cells[16] = {
-                0, 1, 1,
-                1, 1, 0,
-                0, 0, 0,
-            };
+            render_set_color(r, color.r, color.g, color.b, 255);
+            render_fill_rect(r, &rect);
+        }
+    }
+}
 
-            memcpy(box.cells, cells, sizeof(bool) * 16);
-        } break;
+// Full rows go white and shrink away over the line clear.
+void draw_clearing_rows(Render_Buffer *r, Render_Snapshot *s)
+{
+    Board *b = &s->board;
+    if (!b->rows_to_clear) return;
 
-        case Z: {
-            box.width = 3;
-            box.height = 3;
-            box.pivot = vec2_make(1.5f, 1.5f);
-            bool cells[16] = {
-                1, 1, 0,
-                0, 1, 1,
-                0, 0, 0,
-            };
+    float size = s->cell_size * (1.0f - s->clear_progress);
+    float inset = (s->cell_size - size) / 2;
 
-            memcpy(box.cells, cells, sizeof(bool) * 16);
-        } break;
+    render_set_layer(r, Layer_CELLS);
+    render_set_color(r, 255, 255, 255, 255);
+
+    for (int row = 0; row < b->height; row += 1)
+    {
+        if (!(b->rows_to_clear & (1u << row))) continue;
 
-        default: {
-            box.width = 3;
-            box.height = 3;
-            box.pivot = vec2_make(1.5f, 1.5f);
-            bool cells[16] = {
-                0, 0, 0,
-                0, 1, 0,
-                0, 0, 0,
+        for (int column = 0; column < b->width; column += 1)
+        {
+            SDL_Rect rect = (SDL_Rect){
+                (int)(s->board_rect.x + (column * s->cell_size) + inset),
+                (int)(s->board_rect.y + (row * s->cell_size) + inset),
+                (int)(size),
+                (int)(size),
             };
 
-            memcpy(box.cells, cells, sizeof(bool) * 16);
-        } break;
+            render_fill_rect(r, &rect);
+        }
     }
+}
+
+// Particles shrink as they age. Each one is a separate rect, but they only
+// come in a few colors so they batch into a few calls.
+void draw_effects(Render_Buffer *r, Render_Context *c, Render_Snapshot *s)
+{
+    Effects *e = &c->effects;
+    render_set_layer(r, Layer_EFFECTS);
+
+    for (int i = 0; i < e->count; i += 1)
+    {
+        float size = s->cell_size * 0.2f * (e->life[i] / e->lifetime[i]) + 1.0f;
 
-    t.bounding_box = box;
+        SDL_Rect rect = (SDL_Rect){
+            (int)(s->board_rect.x + (e->x[i] * s->cell_size) - size/2),
+            (int)(s->board_rect.y + (e->y[i] * s->cell_size) - size/2),
+            (int)(size),
+            (int)(size),
+        };
 
-    return t;
+        render_set_color(r, e->color[i].r, e->color[i].g, e->color[i].b, 255);
+        render_fill_rect(r, &rect);
+    }
 }
 
-int get_2d_index(int w, int h, int width)
+void draw_buttons(Render_Buffer *r, Render_Snapshot *s)
 {
-    return(h*width + w);
+    for (int i = 0; i < s->button_count; i += 1)
+    {
+        draw_button(r, s->buttons[i]);
+    }
 }
 
-
-bool solid_below(Tetronimo *tetronimo, Board *board)
+// Bring the board cache up to date. Returns false if there's no cache to draw
+// from, because the renderer can't render to textures.
+bool update_board_cache(Render_Context *c, Render_Snapshot *s)
 {
-    for (int i = 0; i < tetronimo->bounding_box.width; i += 1)
-    {
-        for (int j = 0; j < tetronimo->bounding_box.height; j += 1)
-        {
-            int index = get_2d_index(i, j, tetronimo->bounding_box.width);
-            if (!tetronimo->bounding_box.cells[index]) continue;
+    Render_Buffer *r = &c->buffer;
+    Board_Cache *cache = &c->board_cache;
+    int width = s->board_rect.w;
+    int height = s->board_rect.h;
 
-            int width = i + (int)tetronimo->position.x;
-            int height = j + (int)tetronimo->position.y;
+    if (width <= 0 || height <= 0) return false;
 
-            // Check if we hit the floor.
-            if (height == board->height-1) return true;
+    if (!cache->texture || cache->width != width || cache->height != height)
+    {
+        if (cache->texture) SDL_DestroyTexture(cache->texture);
 
-            for (int k = 0; k < board->cell_count; k += 1)
-            {
-                Tetron *t = &board->cells[k];
-                if (!t->exists) continue;
+        cache->texture = SDL_CreateTexture(r->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, width, height);
+        cache->width = width;
+        cache->height = height;
+        cache->valid = false;
 
-                if (t->position.x == width && t->position.y == (height+1))
-                {
-                    return true;
-                }
-            }
-        }
+        if (!cache->texture) return false;
+        SDL_SetTextureBlendMode(cache->texture, SDL_BLENDMODE_NONE);
     }
 
-    return false;
+    if (cache->valid && cache->revision == s->board.revision) return true;
+
+    // Only the cells go through the buffer here, the frame hasn't started yet.
+    if (SDL_SetRenderTarget(r->renderer, cache->texture) != 0) return false;
+    draw_board_cells(r, s, 0, 0);
+    render_flush(r);
+    SDL_SetRenderTarget(r->renderer, NULL);
+
+    cache->revision = s->board.revision;
+    cache->valid = true;
+    return true;
 }
 
-void render_game(SDL_Renderer *renderer, State state, TTF_Font *font)
+void render_game(Render_Context *c, Render_Snapshot *s)
 {
-    SDL_RenderClear(renderer);
+    Render_Buffer *r = &c->buffer;
+    Font *font = &c->font;
 
-    // Set background color.
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderFillRect(renderer, NULL);
+    PROFILE_BEGIN(Profile_BOARD_CACHE);
+    bool cached = update_board_cache(c, s);
+    PROFILE_END(Profile_BOARD_CACHE);
 
-    // Draw the board.
-    SDL_SetRenderDrawColor(renderer, 35, 35, 35, 255);
-    SDL_RenderFillRect(renderer, &state.board.rect);
+    PROFILE_BEGIN(Profile_BOARD);
 
-    float cell_padding = 0.02f;
-    float cell_padding_abs = cell_padding * state.board.cell_size;
+    // Clear to the background color.
+    SDL_SetRenderDrawColor(r->renderer, 0, 0, 0, 255);
+    SDL_RenderClear(r->renderer);
 
-    // Draw the tetrons.
-    for (int i = 0; i < state.board.cell_count; i += 1)
+    // Draw the board and the tetrons.
+    if (cached)
+    {
+        SDL_Rect source = {0, 0, c->board_cache.width, c->board_cache.height};
+        render_set_layer(r, Layer_BOARD);
+        render_set_color(r, 255, 255, 255, 255);
+        render_copy(r, c->board_cache.texture, &source, &s->board_rect);
+    }
+    else
     {
-        Tetron *t = &state.board.cells[i];
-        if (!t->exists) continue;
+        draw_board_cells(r, s, s->board_rect.x, s->board_rect.y);
+    }
 
-        SDL_Rect rect = (SDL_Rect){
-            (int)(state.board.rect.x + ((t->position.x) * state.board.cell_size)),
-            (int)(state.board.rect.y + ((t->position.y) * state.board.cell_size)),
-            (int)(state.board.cell_size),
-            (int)(state.board.cell_size),
-        };
+    draw_clearing_rows(r, s);
 
-        rect.x += (int)(cell_padding_abs);
-        rect.y += (int)(cell_padding_abs);
-        rect.w -= (int)(2*cell_padding_abs);
-        rect.h -= (int)(2*cell_padding_abs);
+    PROFILE_END(Profile_BOARD);
+    PROFILE_BEGIN(Profile_PIECES);
 
-        SDL_SetRenderDrawColor(renderer, t->color.r, t->color.g, t->color.b, 255);
-        SDL_RenderFillRect(renderer, &rect);
-    }
+    float cell_padding = 0.02f;
+    float cell_padding_abs = cell_padding * s->cell_size;
 
-    if (state.board.active)
+    if (s->has_piece)
     {
-        Tetronimo *t = state.board.active;
+        Tetronimo *t = &s->piece;
+        SDL_Color color = get_sdl_color(t->type);
 
         // Draw the tetronimo's drop ghost
-        SDL_SetRenderDrawColor(renderer, t->color.r/5, t->color.g/5, t->color.b/5, 255);
+        render_set_layer(r, Layer_GHOST);
+        render_set_color(r, color.r/5, color.g/5, color.b/5, 255);
 
-        // TODO(bkaylor): We could build the ghost in the not-render-function.
         Tetronimo ghost = *t;
-        while (!solid_below(&ghost, &state.board))
-        {
-            ghost.position.y += 1;
-        }
+        ghost.y = s->board.ghost_y;
 
-        for (int i = 0; i < ghost.bounding_box.width; i += 1)
+        for (int i = 0; i < 4; i += 1)
         {
-            for (int j = 0; j < ghost.bounding_box.height; j += 1)
+            for (int j = 0; j < 4; j += 1)
             {
-                if (ghost.bounding_box.cells[get_2d_index(i, j, ghost.bounding_box.width)])
+                if (get_shape(&ghost)[j] & (1 << i))
                 {
                     SDL_Rect rect = (SDL_Rect){
-                        (int)(state.board.rect.x + ((ghost.position.x + i) * state.board.cell_size)),
-                        (int)(state.board.rect.y + ((ghost.position.y + j) * state.board.cell_size)),
-                        (int)(state.board.cell_size),
-                        (int)(state.board.cell_size),
+                        (int)(s->board_rect.x + ((ghost.x + i) * s->cell_size)),
+                        (int)(s->board_rect.y + ((ghost.y + j) * s->cell_size)),
+                        (int)(s->cell_size),
+                        (int)(s->cell_size),
                     };
 
                     /*
@@ -383,25 +487,37 @@ void render_game(SDL_Renderer *renderer, State state, TTF_Font *font)
                     rect.h -= 2*cell_padding_abs;
                     */
 
-                    SDL_RenderFillRect(renderer, &rect);
+                    render_fill_rect(r, &rect);
                 }
             }
         }
 
-        // Draw the tetronimo.
-        SDL_SetRenderDrawColor(renderer, t->color.r, t->color.g, t->color.b, 255);
+        // Draw the tetronimo, part way between where it was a tick ago and where it is now.
+        Piece_Snapshot now = s->piece_now;
+        Piece_Snapshot before = s->piece_before;
+        float piece_x = now.x;
+        float piece_y = now.y;
+
+        if (before.handle == now.handle && before.rotation == now.rotation)
+        {
+            piece_x = before.x + (now.x - before.x) * s->tick_alpha;
+            piece_y = before.y + (now.y - before.y) * s->tick_alpha;
+        }
+
+        render_set_layer(r, Layer_PIECE);
+        render_set_color(r, color.r, color.g, color.b, 255);
 
-        for (int i = 0; i < t->bounding_box.width; i += 1)
+        for (int i = 0; i < 4; i += 1)
         {
-            for (int j = 0; j < t->bounding_box.height; j += 1)
+            for (int j = 0; j < 4; j += 1)
             {
-                if (t->bounding_box.cells[get_2d_index(i, j, t->bounding_box.width)])
+                if (get_shape(t)[j] & (1 << i))
                 {
                     SDL_Rect rect = (SDL_Rect){
-                        (int)(state.board.rect.x + ((t->position.x + i) * state.board.cell_size)),
-                        (int)(state.board.rect.y + ((t->position.y + j) * state.board.cell_size)),
-                        (int)(state.board.cell_size),
-                        (int)(state.board.cell_size),
+                        (int)(s->board_rect.x + ((piece_x + i) * s->cell_size)),
+                        (int)(s->board_rect.y + ((piece_y + j) * s->cell_size)),
+                        (int)(s->cell_size),
+                        (int)(s->cell_size),
                     };
 
                     rect.x += (int)(cell_padding_abs);
@@ -409,197 +525,348 @@ void render_game(SDL_Renderer *renderer, State state, TTF_Font *font)
                     rect.w -= (int)(2*cell_padding_abs);
                     rect.h -= (int)(2*cell_padding_abs);
 
-                    SDL_RenderFillRect(renderer, &rect);
+                    render_fill_rect(r, &rect);
                 }
             }
         }
 
         /*
-        SDL_SetRenderDrawColor(renderer, 255, 100, 255, 255);
-        draw_circle(renderer,
-                    state.board.rect.x + ((t->position.x) * state.board.cell_size),
-                    state.board.rect.y + ((t->position.y) * state.board.cell_size),
+        render_set_color(r, 255, 100, 255, 255);
+        draw_circle(r,
+                    s->board_rect.x + ((t->x) * s->cell_size),
+                    s->board_rect.y + ((t->y) * s->cell_size),
                     3);
 
-        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-        draw_circle(renderer,
-                    state.board.rect.x + ((t->position.x + t->bounding_box.pivot.x) * state.board.cell_size),
-                    state.board.rect.y + ((t->position.y + t->bounding_box.pivot.y) * state.board.cell_size),
+        render_set_color(r, 255, 255, 255, 255);
+        draw_circle(r,
+                    s->board_rect.x + ((t->x + 1.5f) * s->cell_size),
+                    s->board_rect.y + ((t->y + 1.5f) * s->cell_size),
                     3);
         */
     }
 
-    // Draw the next tetron
-    SDL_Rect next_rect = (SDL_Rect){
-        (int)(state.board.rect.x + (state.board.rect.w * 1.2)),
-        (int)(state.board.rect.y + (state.board.rect.h / 4) - (state.board.cell_size * 2)),
-        (int)(state.board.cell_size * 4),
-        (int)(state.board.cell_size * 4),
-    };
+    // Draw the upcoming tetrons, the next one on top.
+    render_set_layer(r, Layer_CELLS);
+    for (int p = 0; p < s->board.randomizer.preview; p += 1)
+    {
+        SDL_Rect next_rect = (SDL_Rect){
+            (int)(s->board_rect.x + (s->board_rect.w * 1.2)),
+            (int)(s->board_rect.y + (s->board_rect.h / 4) - (s->cell_size * 2) + (s->cell_size * 3 * p)),
+            (int)(s->cell_size * 4),
+            (int)(s->cell_size * 4),
+        };
 
-    Tetronimo next = make_tetronimo(state.board.next, vec2_make(0.0f, 0.0f));
-    SDL_SetRenderDrawColor(renderer, next.color.r, next.color.g, next.color.b, 255);
+        Tetronimo next = make_tetronimo((Tetronimo_Type)randomizer_peek(&s->board.randomizer, p), 0, 0);
+        SDL_Color next_color = get_sdl_color(next.type);
+        render_set_color(r, next_color.r, next_color.g, next_color.b, 255);
 
-    for (int i = 0; i < next.bounding_box.width; i += 1)
-    {
-        for (int j = 0; j < next.bounding_box.height; j += 1)
+        for (int i = 0; i < 4; i += 1)
         {
-            if (next.bounding_box.cells[get_2d_index(i, j, next.bounding_box.width)])
+            for (int j = 0; j < 4; j += 1)
             {
-                SDL_Rect rect = (SDL_Rect){
-                    (int)(next_rect.x + ((next.position.x + i) * state.board.cell_size)),
-                    (int)(next_rect.y + ((next.position.y + j) * state.board.cell_size)),
-                    (int)(state.board.cell_size),
-                    (int)(state.board.cell_size),
-                };
-
-                rect.x += (int)(cell_padding_abs);
-                rect.y += (int)(cell_padding_abs);
-                rect.w -= (int)(2*cell_padding_abs);
-                rect.h -= (int)(2*cell_padding_abs);
-
-                SDL_RenderFillRect(renderer, &rect);
+                if (get_shape(&next)[j] & (1 << i))
+                {
+                    SDL_Rect rect = (SDL_Rect){
+                        (int)(next_rect.x + ((next.x + i) * s->cell_size)),
+                        (int)(next_rect.y + ((next.y + j) * s->cell_size)),
+                        (int)(s->cell_size),
+                        (int)(s->cell_size),
+                    };
+
+                    rect.x += (int)(cell_padding_abs);
+                    rect.y += (int)(cell_padding_abs);
+                    rect.w -= (int)(2*cell_padding_abs);
+                    rect.h -= (int)(2*cell_padding_abs);
+
+                    render_fill_rect(r, &rect);
+                }
             }
         }
     }
 
+    PROFILE_END(Profile_PIECES);
+
+    PROFILE_BEGIN(Profile_DRAW_PARTICLES);
+    draw_effects(r, c, s);
+    PROFILE_END(Profile_DRAW_PARTICLES);
+
+    PROFILE_BEGIN(Profile_HUD);
+
     // Draw the score and timer
+    render_set_layer(r, Layer_HUD);
     char buf[50];
 
-    sprintf_s(buf, 50, "%d", state.board.score);
-    draw_text(renderer, (int)(state.board.rect.x*0.8f), (int)(state.board.rect.h*0.25f), buf, font, (SDL_Color){225, 225, 225, 225});
+    sprintf_s(buf, 50, "%d", s->board.score);
+    draw_text(r, (int)(s->board_rect.x*0.8f), (int)(s->board_rect.h*0.25f), buf, font, (SDL_Color){225, 225, 225, 225});
 
-    Uint64 seconds = state.timer/1000;
-    Uint64 ms = state.timer - (seconds*1000);
+    Uint64 seconds = s->timer/1000000;
+    Uint64 ms = (s->timer/1000) % 1000;
     sprintf_s(buf, 50, "%lld.%lld", seconds, ms);
-    draw_text(renderer, (int)(state.board.rect.x*0.8), (int)(state.board.rect.h*0.25f + 25.0f), buf, font, (SDL_Color){225, 225, 225, 225});
+    draw_text(r, (int)(s->board_rect.x*0.8), (int)(s->board_rect.h*0.25f + 25.0f), buf, font, (SDL_Color){225, 225, 225, 225});
 
     // Draw history
-    sprintf_s(buf, 50, "%d", state.score_history);
-    draw_text(renderer, (int)(state.board.rect.x*0.8f), (int)(state.board.rect.h*0.25f + 50.0f), buf, font, (SDL_Color){225, 225, 225, 225});
+    sprintf_s(buf, 50, "%d", s->score_history);
+    draw_text(r, (int)(s->board_rect.x*0.8f), (int)(s->board_rect.h*0.25f + 50.0f), buf, font, (SDL_Color){225, 225, 225, 225});
 
-    Uint64 seconds_history = state.timer_history/1000;
-    Uint64 ms_history = state.timer_history - (seconds_history*1000);
+    Uint64 seconds_history = s->timer_history/1000000;
+    Uint64 ms_history = (s->timer_history/1000) % 1000;
     sprintf_s(buf, 50, "%lld.%lld", seconds_history, ms_history);
-    draw_text(renderer, (int)(state.board.rect.x*0.8f), (int)(state.board.rect.h*0.25f + 75.0f), buf, font, (SDL_Color){225, 225, 225, 225});
+    draw_text(r, (int)(s->board_rect.x*0.8f), (int)(s->board_rect.h*0.25f + 75.0f), buf, font, (SDL_Color){225, 225, 225, 225});
 
     // Draw debug text.
-    /*
-    char buf[50];
-    int y = 0;
-
-    DEBUG_PRINT("%d ms", state.turn_timer);
-    DEBUG_PRINT("%d lines", state.board.score);
-    DEBUG_PRINT("%d entities", state.board.entity_count);
-    */
+    if (s->show_debug)
+    {
+        int y = 0;
+        render_set_layer(r, Layer_HUD);
+
+        DEBUG_PRINT("%.1f ms input to present", c->pacer.latency * 1000.0);
+        DEBUG_PRINT("%.1f ms average", c->pacer.average_latency * 1000.0);
+        DEBUG_PRINT("%.2f ms frame period", c->pacer.period * 1000.0);
+        DEBUG_PRINT("%.2f ms frame work", c->pacer.work * 1000.0);
+        DEBUG_PRINT("%s", c->pacer.enabled ? "low latency" : "normal");
+        DEBUG_PRINT("%d lines", s->board.score);
+        DEBUG_PRINT("%d tetronimos", s->tetronimo_count);
+    }
 
     // Draw pause menu
-    if (state.paused)
+    if (s->paused)
     {
+        render_set_layer(r, Layer_MENU);
+        render_set_color(r, 15, 15, 15, 255);
+        render_fill_rect(r, &s->pause_menu_rect);
+    }
+
+    draw_buttons(r, s);
+
+    if (s->show_profile) profile_draw(r, font, s->window.x - 8, 8);
+
+    PROFILE_END(Profile_HUD);
+
+    PROFILE_BEGIN(Profile_FLUSH);
+    render_flush(r);
+    PROFILE_END(Profile_FLUSH);
+}
+
+void sim_clock_init(Sim_Clock *clock, int rate)
+{
+    if (rate < SIM_MIN_RATE) rate = SIM_MIN_RATE;
+    if (rate > SIM_MAX_RATE) rate = SIM_MAX_RATE;
+
+    clock->rate = rate;
+    clock->frequency = SDL_GetPerformanceFrequency();
+    clock->last_counter = SDL_GetPerformanceCounter();
+    clock->accumulator = 0;
+    clock->ticks = 0;
+}
+
+// Add the time since the last call. With running false the time passes without
+// being simulated, for menus and pausing.
+void sim_clock_advance(Sim_Clock *clock, bool running)
+{
+    Uint64 counter = SDL_GetPerformanceCounter();
+    Uint64 elapsed = counter - clock->last_counter;
+    clock->last_counter = counter;
 
-        SDL_SetRenderDrawColor(renderer, 15, 15, 15, 255);
-        SDL_RenderFillRect(renderer, &state.board.pause_menu_rect);
+    if (!running)
+    {
+        clock->accumulator = 0;
+        return;
     }
 
-    draw_all_buttons(renderer, &state.gui);
+    Uint64 limit = clock->frequency * SIM_MAX_CATCH_UP / 1000 * (Uint64)clock->rate;
+
+    clock->accumulator += elapsed * (Uint64)clock->rate;
+    if (clock->accumulator > limit) clock->accumulator = limit;
+}
+
+// Add exactly ticks ticks, however long it's been, for runs that have to
+// play out the same every time.
+void sim_clock_add_ticks(Sim_Clock *clock, int ticks)
+{
+    clock->last_counter = SDL_GetPerformanceCounter();
+    clock->accumulator += clock->frequency * (Uint64)ticks;
+}
+
+// How far the accumulator is towards the next tick, from 0 to 1.
+float sim_clock_alpha(Sim_Clock *clock)
+{
+    // Ticks can be left over when a frame stops early for a new game.
+    if (clock->accumulator >= clock->frequency) return 1.0f;
+    return (float)clock->accumulator / (float)clock->frequency;
+}
+
+// Take one tick out of the accumulator. Returns its length in microseconds, or 0 if
+// there isn't a whole tick left.
+Uint64 sim_clock_tick(Sim_Clock *clock)
+{
+    if (clock->accumulator < clock->frequency) return 0;
+    clock->accumulator -= clock->frequency;
+
+    Uint64 dt = game_tick_dt(clock->rate, clock->ticks);
+    clock->ticks += 1;
+
+    return dt;
+}
 
-    SDL_RenderPresent(renderer);
+void frame_pacer_init(Frame_Pacer *pacer, SDL_Window *window, bool enabled)
+{
+    SDL_DisplayMode mode;
+    int refresh_rate = 60;
+    if (SDL_GetWindowDisplayMode(window, &mode) == 0 && mode.refresh_rate > 0) refresh_rate = mode.refresh_rate;
+
+    pacer->enabled = enabled;
+    pacer->frequency = SDL_GetPerformanceFrequency();
+    pacer->period = 1.0 / refresh_rate;
+    pacer->work = pacer->period / 2;
+    pacer->last_present = 0;
+    pacer->wake = SDL_GetPerformanceCounter();
+    pacer->rendered = pacer->wake;
+    pacer->latency = 0.0;
+    pacer->average_latency = 0.0;
 }
 
-void copy_tetron_to(Tetron *source, Tetron *destination)
+static double frame_pacer_seconds(Frame_Pacer *pacer, Uint64 from, Uint64 to)
 {
-    destination->id = source->id;
-    destination->color = source->color;
-    destination->marked_for_delete = source->marked_for_delete;
-    destination->exists = source->exists;
-    // destination->position = source->position;
+    return (double)(to - from) / (double)pacer->frequency;
 }
 
-void transform_to_tetrons(Tetronimo *tetronimo, Board *board)
+// Call at the top of the frame, before reading input.
+void frame_pacer_wait(Frame_Pacer *pacer)
 {
-    for (int i = 0; i < tetronimo->bounding_box.width; i += 1)
+    if (pacer->enabled && pacer->last_present)
     {
-        for (int j = 0; j < tetronimo->bounding_box.height; j += 1)
-        {
-            int index = get_2d_index(i, j, tetronimo->bounding_box.width);
-            if (!tetronimo->bounding_box.cells[index]) continue;
+        Uint64 now = SDL_GetPerformanceCounter();
 
-            int x = (int)tetronimo->position.x + i;
-            int y = (int)tetronimo->position.y + j;
+        // The first vblank after now, and when to wake up to be ready for it.
+        double since = frame_pacer_seconds(pacer, pacer->last_present, now);
+        double vblank = pacer->period * (double)((Uint64)(since / pacer->period) + 1);
+        double wake = vblank - pacer->work - PACER_MARGIN;
 
-            Tetron t;
-            t.id = 0;
-            t.color = tetronimo->color;
-            t.marked_for_delete = false;
-            t.exists = true;
-            t.position = vec2_make((float)x, (float)y);
+        // Too late for this one, go for the next.
+        if (wake < since) wake += pacer->period;
 
-            board->cells[get_2d_index(x, y, 10)] = t;
-            // board->cell_count += 1;
-        }
+        Uint64 target = pacer->last_present + (Uint64)(wake * (double)pacer->frequency);
+
+        // Sleep most of the way, then spin, since SDL_Delay can oversleep by a millisecond or more.
+        double remaining = frame_pacer_seconds(pacer, now, target);
+        if (remaining > 0.002) SDL_Delay((Uint32)((remaining - 0.002) * 1000.0));
+        while (SDL_GetPerformanceCounter() < target) {}
     }
+
+    pacer->wake = SDL_GetPerformanceCounter();
+}
+
+// Call when the frame is ready to present.
+void frame_pacer_rendered(Frame_Pacer *pacer)
+{
+    pacer->rendered = SDL_GetPerformanceCounter();
+
+    // Jump up to a slow frame straight away, come back down slowly.
+    double work = frame_pacer_seconds(pacer, pacer->wake, pacer->rendered);
+    pacer->work = work > pacer->work ? work : pacer->work * 0.98 + work * 0.02;
 }
 
-bool collides_with_wall(Tetronimo *a, Board *b)
+// Call when SDL_RenderPresent returns.
+void frame_pacer_presented(Frame_Pacer *pacer)
 {
-    for (int j = 0; j < a->bounding_box.width; j += 1)
+    Uint64 now = SDL_GetPerformanceCounter();
+
+    // Only intervals of about one frame say anything about the refresh rate.
+    if (pacer->last_present)
     {
-        for (int k = 0; k < a->bounding_box.height; k += 1)
+        double interval = frame_pacer_seconds(pacer, pacer->last_present, now);
+        if (interval > pacer->period * 0.75 && interval < pacer->period * 1.25)
         {
-            int index = get_2d_index(j, k, a->bounding_box.width);
+            pacer->period = pacer->period * 0.95 + interval * 0.05;
+        }
+    }
 
-            if (!a->bounding_box.cells[index]) continue;
+    pacer->last_present = now;
+    pacer->latency = frame_pacer_seconds(pacer, pacer->wake, now);
+    pacer->average_latency = pacer->average_latency * 0.9 + pacer->latency * 0.1;
+}
 
-            int width = j + (int)a->position.x;
-            // int height = k + (int)a->position.y;
+// Save the game being recorded, if it got going.
+void finish_recording(State *state)
+{
+    Replay *r = &state->recording;
+    if (r->tick == 0) return;
 
-            if (width < 0 || width >= b->width)
-            {
-                return true;
-            }
-        }
+    if (!state->save_replays)
+    {
+        r->tick = 0;
+        return;
     }
 
-    return false;
+    char path[64];
+    sprintf_s(path, 64, "replay_%lld_%llu.trp", (long long)time(0), (unsigned long long)r->seed);
+
+    replay_end(r);
+    replay_save(r, path);
+    r->tick = 0;
+}
+
+void stop_playback(State *state)
+{
+    state->playing = false;
+    state->screen = Screen_MENU;
+    state->game.reset = true;
 }
 
-bool collides_with_cells(Tetronimo *a, Board *b)
+void start_game(State *state)
 {
-    for (int j = 0; j < a->bounding_box.width; j += 1)
+    // Save last game's score.
+    state->score_history = state->game.board.score;
+    state->timer_history = state->game.timer;
+
+    finish_recording(state);
+
+    if (!state->playing)
     {
-        for (int k = 0; k < a->bounding_box.height; k += 1)
-        {
-            int index = get_2d_index(j, k, a->bounding_box.width);
+        if (!state->fixed_seed) state->game.seed = (uint64_t)time(0) ^ SDL_GetPerformanceCounter();
+        replay_begin(&state->recording, &state->game, state->clock.rate);
+    }
 
-            if (!a->bounding_box.cells[index]) continue;
+    state->clock.ticks = 0;
 
-            int width = j + (int)a->position.x;
-            int height = k + (int)a->position.y;
+    float cell_width  = (float)(state->window.x / BOARD_WIDTH);
+    float cell_height = (float)(state->window.y / BOARD_HEIGHT);
 
-            int world_index = get_2d_index(width, height, 10);
-            for (int i = 0; i < b->cell_count; i += 1)
-            {
-                if (b->cells[i].exists && i == world_index) return true;
-            }
-        }
+    float cell_size = cell_width < cell_height ? cell_width : cell_height;
+    state->cell_size = cell_size;
+
+    state->board_rect.w = (int)(cell_size * BOARD_WIDTH);
+    state->board_rect.h = (int)(cell_size * BOARD_HEIGHT);
+
+    state->board_rect.y = state->window.y - state->board_rect.h;
+    state->board_rect.x = (state->window.x/2) - (state->board_rect.w/2);
+}
+
+// Move the game's events into the numbered log that snapshots copy.
+void take_events(State *state)
+{
+    for (int i = 0; i < state->game.event_count; i += 1)
+    {
+        state->events[state->event_count % SNAPSHOT_EVENTS] = state->game.events[i];
+        state->event_count += 1;
     }
 
-    return false;
+    state->game.event_count = 0;
 }
 
-void update_game(State *state, Uint64 dt)
+void update_game(State *state)
 {
     if (state->paused)
     {
         float padding = 0.2f;
         SDL_Rect pause_menu_rect = (SDL_Rect) {
-            (int)(state->board.rect.x + (state->board.rect.w * padding)),
-            (int)(state->board.rect.y + (state->board.rect.h * padding)),
-            (int)(state->board.rect.w * (1.0 - 2*padding)),
-            (int)(state->board.rect.h * (1.0 - 2*padding)),
+            (int)(state->board_rect.x + (state->board_rect.w * padding)),
+            (int)(state->board_rect.y + (state->board_rect.h * padding)),
+            (int)(state->board_rect.w * (1.0 - 2*padding)),
+            (int)(state->board_rect.h * (1.0 - 2*padding)),
         };
 
-        state->board.pause_menu_rect = pause_menu_rect;
+        state->pause_menu_rect = pause_menu_rect;
 
         Gui *g = &state->gui;
 
@@ -627,316 +894,45 @@ void update_game(State *state, Uint64 dt)
         return;
     }
 
-    Board *b = &state->board;
-
-    if (state->reset)
+    // A replay is over once its game ends (or R is pressed).
+    if (state->playing && state->game.reset && state->player.tick > 0)
     {
-        // Save last game's score.
-        state->score_history = b->score;
-        state->timer_history = state->timer;
-
-        b->width = 10;
-        b->height = 20;
-        b->entity_count = 0;
-
-        float cell_width  = (float)(state->window.x / b->width);
-        float cell_height = (float)(state->window.y / b->height);
-
-        float cell_size = cell_width < cell_height ? cell_width : cell_height;
-        b->cell_size = cell_size;
-
-        b->rect.w = (int)(cell_size * b->width);
-        b->rect.h = (int)(cell_size * b->height);
-
-        b->rect.y = state->window.y - b->rect.h;
-        b->rect.x = (state->window.x/2) - (b->rect.w/2);
-
-        b->active = NULL;
-        b->ghost = NULL;
-        b->check_for_clear = false;
-        b->there_are_rows_to_be_cleared = false;
-        b->score = 0;
-
-        b->next = (rand() % 7) + 1;
-
-        for (int i = 0; i < 20*10; i += 1)
-        {
-            b->cells[i].exists = false;
-            b->cells[i].marked_for_delete = false;
-        }
-
-        b->cell_count = 20*10;
-
-        state->do_drop             = false;
-        state->do_left_move        = false;
-        state->do_right_move       = false;
-        state->do_down_move        = false;
-        state->do_rotate_clockwise = false;
-
-        state->timer = 0;
-        state->turn_timer = 0;
-        state->turn_count = 0;
-
-        state->reset = false;
+        stop_playback(state);
+        return;
     }
 
-    if (!b->active)
-    {
-        // Spawn a tetronimo.
-        Tetronimo t = make_tetronimo(b->next, vec2_make((float)((b->width/2)-2), 0));
-        b->next = (rand() % 7) + 1;
+    if (state->game.reset) start_game(state);
 
-        b->entities[b->entity_count] = t;
-        b->active = &(b->entities[b->entity_count]);
-        b->entity_count += 1;
-
-        if (collides_with_cells(&t, b)) state->reset = true;
-    }
-
-    // Handle inputs on the active tetronimo.
-    if (b->active)
+    Uint64 dt;
+    while ((dt = sim_clock_tick(&state->clock)) > 0)
     {
-        Tetronimo *a = b->active;
-
-        if (state->do_left_move)
-        {
-            a->position.x -= 1;
-            if (collides_with_wall(a, b) || collides_with_cells(a, b))
-            {
-                a->position.x += 1;
-            }
-
-            state->do_left_move = false;
-        }
-
-        if (state->do_right_move)
-        {
-            a->position.x += 1;
-            if (collides_with_wall(a, b) || collides_with_cells(a, b))
-            {
-                a->position.x -= 1;
-            }
-
-            state->do_right_move = false;
-        }
-
-        if (state->do_down_move)
-        {
-            state->turn_timer = TICK_TIME;
-            state->do_down_move = false;
-        }
-
-        if (state->do_drop)
+        if (state->playing)
         {
-            while (!solid_below(a, b))
-            {
-                a->position.y += 1;
-            }
-
-            transform_to_tetrons(a, b);
-            b->active = NULL;
-            b->check_for_clear = true;
-
-            state->turn_timer = TICK_TIME;
-
-            state->do_drop = false;
-        }
-
-        if ((state->do_rotate_clockwise || state->do_rotate_counter_clockwise) && !(a->type == O))
-        {
-            bool original_cells[16];
-            bool cells_transposed[16];
-            bool cells_reversed[16];
-
-            // Save initial state
-            // original_cells = a->bounding_box.cells;
-            for (int i = 0; i < a->bounding_box.width; i += 1)
-            {
-                for (int j = 0; j < a->bounding_box.height; j += 1)
-                {
-                    int index = j * a->bounding_box.width + i;
-                    original_cells[index] = a->bounding_box.cells[index];
-                }
-            }
-
-            // Transpose
-            for (int i = 0; i < a->bounding_box.width; i += 1)
-            {
-                for (int j = 0; j < a->bounding_box.height; j += 1)
-                {
-                    int index = j * a->bounding_box.width + i;
-                    cells_transposed[i * a->bounding_box.height + j] = a->bounding_box.cells[index];
-                }
-            }
-
-            if (state->do_rotate_clockwise)
+            if (!replay_play(&state->player, &state->game))
             {
-                // Reverse rows
-                for (int i = 0; i < a->bounding_box.width; i += 1)
-                {
-                    for (int j = 0; j < a->bounding_box.height; j += 1)
-                    {
-                        int old_index = j * a->bounding_box.height + i;
-                        int new_index = j * a->bounding_box.width + ((a->bounding_box.width-1) - i);
-                        cells_reversed[new_index] = cells_transposed[old_index];
-                    }
-                }
-
-                state->do_rotate_clockwise = false;
-            }
-
-            if (state->do_rotate_counter_clockwise)
-            {
-                // Reverse columns
-                for (int i = 0; i < a->bounding_box.width; i += 1)
-                {
-                    for (int j = 0; j < a->bounding_box.height; j += 1)
-                    {
-                        int old_index = j * a->bounding_box.height + i;
-                        int new_index = ((a->bounding_box.height -1) - j) * a->bounding_box.width +  i;
-                        cells_reversed[new_index] = cells_transposed[old_index];
-                    }
-                }
-
-                state->do_rotate_counter_clockwise = false;
-            }
-
-            // cells_reversed now contains the fully transformed grid of cells.
-            // Check that, given this new grid, we aren't colliding with anything.
-            // If we are, undo the operation.
-
-            for (int i = 0; i < a->bounding_box.width; i += 1)
-            {
-                for (int j = 0; j < a->bounding_box.height; j += 1)
-                {
-                    int index = j * a->bounding_box.width + i;
-                    a->bounding_box.cells[index] = cells_reversed[index];
-                }
-            }
-
-            // Wallbang!
-            if (collides_with_wall(a, b) || collides_with_cells(a, b))
-            {
-                a->position.x -= 1;
-                if (collides_with_wall(a, b) || collides_with_cells(a, b))
-                {
-                    a->position.x += 2;
-                    if (collides_with_wall(a, b) || collides_with_cells(a, b))
-                    {
-                        a->position.x -= 1;
-
-                        for (int i = 0; i < a->bounding_box.width; i += 1)
-                        {
-                            for (int j = 0; j < a->bounding_box.height; j += 1)
-                            {
-                                int index = j * a->bounding_box.width + i;
-                                a->bounding_box.cells[index] = original_cells[index];
-                            }
-                        }
-                    }
-                }
-            }
-        }
-    }
-
-    state->turn_timer += dt;
-    state->timer += dt;
-
-    if (state->turn_timer >= TICK_TIME)
-    {
-        state->turn_timer = 0;
-        state->turn_count += 1;
-
-        // Timer ran out, move the active tetronimo.
-        if (b->active)
-        {
-            if (solid_below(b->active, b)) {
-                transform_to_tetrons(b->active, b);
-                b->check_for_clear = true;
-                b->active = NULL;
-            } else {
-                b->active->position.y += 1;
+                stop_playback(state);
+                break;
             }
         }
-
-        // Find white rows, delete them and shift other rows down.
-        if (b->there_are_rows_to_be_cleared)
+        else
         {
-            Tetron *grid = b->cells;
-
-            for (int row = 0; row < 20; row += 1)
-            {
-                for (int column = 0; column < 10; column += 1)
-                {
-                    Tetron *t = &grid[get_2d_index(column, row, 10)];
-                    if (!t->exists) continue;
-
-                    if (t->marked_for_delete) {
-                        // t->exists = false;
-
-                        // Bump down any rows above.
-                        for (int row_above = row; row_above > 0; row_above -= 1)
-                        {
-                            // TODO(bkaylor): There is some weirdness around positions. We never really reset them
-                            // after a tetronimo gets converted to tetrons. So they're static ... ish.
-                            // This raw copy will work later when the position handling is fixed.
-                            // In general I'm not sure how to handle positions in a grid-based game. Keeping the
-                            // indices into the grid and the position on the entity itself in line with each other
-                            // can cause weird hard-to-find bugs like this.
-                            //
-                            // grid[get_2d_index(column, row_above, 10)] = grid[get_2d_index(column, row_above-1, 10)];
-                            //
-
-                            Tetron *destination = &grid[get_2d_index(column, row_above, 10)];
-                            Tetron *source      = &grid[get_2d_index(column, row_above-1, 10)];
-                            copy_tetron_to(source, destination);
-                        }
-
-                        t->marked_for_delete = false;
-                    }
-                }
-            }
-
-            b->there_are_rows_to_be_cleared = false;
+            replay_record(&state->recording, &state->game);
         }
-    }
 
-    if (b->check_for_clear)
-    {
-        Tetron *grid = b->cells;
+        TRACE_BEGIN(tick);
 
-        // Figure out which rows are filled.
-        for (int row = 0; row < 20; row += 1)
-        {
-            bool row_is_filled = true;
-            for (int column = 0; column < 10; column += 1)
-            {
-                Tetron *t = &grid[get_2d_index(column, row, 10)];
-                if (!t->exists) {
-                    row_is_filled = false;
-                    break;
-                }
-            }
+        state->previous_piece = snapshot_piece(&state->game);
+        game_update(&state->game, dt);
 
-            if (row_is_filled)
-            {
-                // Set cells to white and mark for delete.
-                for (int column = 0; column < 10; column += 1)
-                {
-                    Tetron *t = &grid[get_2d_index(column, row, 10)];
-                    t->marked_for_delete = true;
-                    t->color = (SDL_Color){255, 255, 255, 255};
-                }
+        TRACE_END(tick);
 
-                b->there_are_rows_to_be_cleared = true;
-                b->score += 1;
-            }
-        }
+        take_events(state);
 
-        b->check_for_clear = false;
+        // Leave the rest of the ticks for the next frame, so a new game goes through start_game first.
+        if (state->game.reset) break;
     }
 
-    return;
+    state->tick_alpha = sim_clock_alpha(&state->clock);
 }
 
 void get_input(State *state)
@@ -951,6 +947,9 @@ void get_input(State *state)
         switch (event.type)
         {
             case SDL_KEYDOWN:
+                if (event.key.keysym.sym == SDLK_F3) state->show_debug = !state->show_debug;
+                if (event.key.keysym.sym == SDLK_F4) state->show_profile = !state->show_profile;
+
                 if (state->screen == Screen_GAME)
                 {
                     if (!state->paused) // Game / Unpaused
@@ -958,15 +957,15 @@ void get_input(State *state)
                         switch (event.key.keysym.sym)
                         {
                             case SDLK_ESCAPE: state->paused = !state->paused; break;
-                            case SDLK_r: state->reset = true; break;
+                            case SDLK_r: state->game.reset = true; break;
 
-                            case SDLK_UP: state->do_drop = true; break;
-                            case SDLK_RIGHT: state->do_right_move = true; break;
-                            case SDLK_DOWN: state->do_down_move = true; break;
-                            case SDLK_LEFT: state->do_left_move = true; break;
+                            case SDLK_UP: state->game.do_drop = true; break;
+                            case SDLK_RIGHT: state->game.do_right_move = true; break;
+                            case SDLK_DOWN: state->game.do_down_move = true; break;
+                            case SDLK_LEFT: state->game.do_left_move = true; break;
 
-                            case SDLK_x: state->do_rotate_clockwise = true; break;
-                            case SDLK_z: state->do_rotate_counter_clockwise = true; break;
+                            case SDLK_x: state->game.do_rotate_clockwise = true; break;
+                            case SDLK_z: state->game.do_rotate_counter_clockwise = true; break;
                         }
                     }
                     else // Game / Paused
@@ -993,6 +992,12 @@ void get_input(State *state)
                 }
                 break;
 
+            case SDL_RENDER_TARGETS_RESET:
+            case SDL_RENDER_DEVICE_RESET:
+                // Texture contents are gone, the renderer has to draw the board again.
+                state->render_resets += 1;
+                break;
+
             case SDL_QUIT:
                 state->quit = true;
                 break;
@@ -1003,27 +1008,37 @@ void get_input(State *state)
     }
 }
 
-void render_menu(SDL_Renderer *renderer, State state, TTF_Font *font)
+void render_menu(Render_Context *c, Render_Snapshot *s)
 {
-    SDL_RenderClear(renderer);
+    Render_Buffer *r = &c->buffer;
+    Font *font = &c->font;
+
+    PROFILE_BEGIN(Profile_HUD);
 
-    // Set background color
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderFillRect(renderer, NULL);
+    // Clear to the background color.
+    SDL_SetRenderDrawColor(r->renderer, 0, 0, 0, 255);
+    SDL_RenderClear(r->renderer);
 
     // Title
     char buf[50];
-    int x = (int)(state.window.x*0.5f);
-    int y = (int)(state.window.y*0.3f);
+    int x = (int)(s->window.x*0.5f);
+    int y = (int)(s->window.y*0.3f);
 
+    render_set_layer(r, Layer_HUD);
     sprintf_s(buf, 50, "%s", "Tetris");
-    draw_text(renderer, x, y, buf, font, (SDL_Color){225, 225, 225, 225});
+    draw_text(r, x, y, buf, font, (SDL_Color){225, 225, 225, 225});
 
 
     // Buttons
-    draw_all_buttons(renderer, &state.gui);
+    draw_buttons(r, s);
 
-    SDL_RenderPresent(renderer);
+    if (s->show_profile) profile_draw(r, font, s->window.x - 8, 8);
+
+    PROFILE_END(Profile_HUD);
+
+    PROFILE_BEGIN(Profile_FLUSH);
+    render_flush(r);
+    PROFILE_END(Profile_FLUSH);
 }
 
 void update_menu(State *state)
@@ -1035,7 +1050,8 @@ void update_menu(State *state)
     if (do_button(g, "Play"))
     {
         state->screen = Screen_GAME;
-        state->reset = true;
+        state->game.reset = true;
+        state->playing = false;
     }
 
     if (do_button(g, "Quit"))
@@ -1044,30 +1060,182 @@ void update_menu(State *state)
     }
 }
 
-void render(SDL_Renderer *renderer, State state, TTF_Font *font)
+void take_snapshot(State *state, Render_Snapshot *s)
+{
+    Board *b = &state->game.board;
+
+    s->screen = state->screen;
+    s->paused = state->paused;
+    s->show_debug = state->show_debug;
+    s->show_profile = state->show_profile;
+    s->window = state->window;
+
+    s->board = *b;
+    s->board.tetronimos = (Pool){0};
+    s->tetronimo_count = b->tetronimos.count;
+
+    Tetronimo *t = get_active(b);
+    s->has_piece = t != NULL;
+    if (t) s->piece = *t;
+
+    s->piece_before = state->previous_piece;
+    s->piece_now = snapshot_piece(&state->game);
+    s->tick_alpha = state->tick_alpha;
+    s->clear_progress = clear_progress(&state->game);
+
+    s->timer = state->game.timer;
+    s->score_history = state->score_history;
+    s->timer_history = state->timer_history;
+
+    s->board_rect = state->board_rect;
+    s->cell_size = state->cell_size;
+    s->pause_menu_rect = state->pause_menu_rect;
+
+    s->button_count = state->gui.button_count;
+    memcpy(s->buttons, state->gui.buttons_to_render, (size_t)s->button_count * sizeof(Button));
+
+    memcpy(s->events, state->events, sizeof(s->events));
+    s->event_count = state->event_count;
+    s->render_resets = state->render_resets;
+}
+
+// Make the renderer and everything drawn with it, on the thread that will use them.
+// Without vsync presents return straight away. Falls back to whatever renderer
+// there is, the software one with no display.
+bool render_context_init(Render_Context *c, SDL_Window *window, TTF_Font *ttf, Arena *arena, int capacity, bool low_latency, bool vsync)
 {
-    switch (state.screen)
+    Uint32 flags = vsync ? SDL_RENDERER_PRESENTVSYNC : 0;
+
+    c->window = window;
+    c->renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | flags);
+    if (!c->renderer) c->renderer = SDL_CreateRenderer(window, -1, flags);
+    if (!c->renderer)
+    {
+        c->error_title = "Error: Renderer";
+        sprintf_s(c->error, 256, "%s", SDL_GetError());
+        return false;
+    }
+
+    if (!font_init(&c->font, c->renderer, ttf))
+    {
+        c->error_title = "Error: Font";
+        sprintf_s(c->error, 256, "%s", SDL_GetError());
+        return false;
+    }
+
+    render_init(&c->buffer, arena, c->renderer, capacity);
+    effects_init(&c->effects, arena);
+    frame_pacer_init(&c->pacer, window, low_latency);
+
+    c->events_seen = 0;
+    c->render_resets = 0;
+    c->last_frame = SDL_GetPerformanceCounter();
+    return true;
+}
+
+void render_context_free(Render_Context *c)
+{
+    if (c->board_cache.texture) SDL_DestroyTexture(c->board_cache.texture);
+    c->board_cache.texture = NULL;
+
+    font_free(&c->font);
+    if (c->renderer) SDL_DestroyRenderer(c->renderer);
+    c->renderer = NULL;
+}
+
+// Draw a snapshot and present it.
+void render(Render_Context *c, Render_Snapshot *s)
+{
+    Uint64 now = SDL_GetPerformanceCounter();
+    float dt = (float)(now - c->last_frame) / (float)SDL_GetPerformanceFrequency();
+    PROFILE_RECORD(Profile_FRAME, now - c->last_frame);
+    c->last_frame = now;
+
+    // Particles don't leap ahead after a stall.
+    if (dt > 0.1f) dt = 0.1f;
+
+    if (s->render_resets != c->render_resets)
+    {
+        c->board_cache.valid = false;
+        c->render_resets = s->render_resets;
+    }
+
+    TRACE_BEGIN(render);
+    PROFILE_BEGIN(Profile_PARTICLES);
+
+    // Events this renderer hasn't seen yet, as many as the snapshot still has.
+    uint64_t first = c->events_seen;
+    if (s->event_count - first > SNAPSHOT_EVENTS) first = s->event_count - SNAPSHOT_EVENTS;
+
+    for (uint64_t i = first; i < s->event_count; i += 1)
+    {
+        effects_add_event(&c->effects, &s->board, &s->events[i % SNAPSHOT_EVENTS]);
+    }
+    c->events_seen = s->event_count;
+
+    if (s->screen == Screen_GAME && !s->paused) effects_update(&c->effects, dt);
+
+    PROFILE_END(Profile_PARTICLES);
+
+    switch (s->screen)
     {
         case Screen_GAME:
         {
-            render_game(renderer, state, font);
+            render_game(c, s);
         } break;
 
         case Screen_MENU:
         default:
         {
-            render_menu(renderer, state, font);
+            render_menu(c, s);
         } break;
     }
+
+    frame_pacer_rendered(&c->pacer);
+    TRACE_END(render);
+
+    TRACE_BEGIN(present);
+    PROFILE_BEGIN(Profile_PRESENT);
+    SDL_RenderPresent(c->renderer);
+    PROFILE_END(Profile_PRESENT);
+    TRACE_END(present);
+
+    frame_pacer_presented(&c->pacer);
 }
 
-void update(State *state, Uint64 dt)
+int render_thread_main(void *data)
+{
+    Render_Thread *t = data;
+    Render_Context *c = t->context;
+    trace_thread_name("render");
+
+    t->ok = render_context_init(c, t->window, t->ttf, t->arena, t->capacity, false, true);
+    SDL_SemPost(t->ready);
+    if (!t->ok) return 1;
+
+    while (!SDL_AtomicGet(&t->quit))
+    {
+        frame_pacer_wait(&c->pacer);
+
+        // The same snapshot again still moves the particles. Presenting waits
+        // for vblank, but without vsync don't spin on old snapshots.
+        int slot;
+        if (!triple_buffer_acquire(&t->buffer, &slot)) SDL_Delay(1);
+
+        render(c, &t->snapshots[slot]);
+    }
+
+    render_context_free(c);
+    return 0;
+}
+
+void update(State *state)
 {
     switch (state->screen)
     {
         case Screen_GAME:
         {
-            update_game(state, dt);
+            update_game(state);
         } break;
 
         case Screen_MENU:
@@ -1080,8 +1248,112 @@ void update(State *state, Uint64 dt)
 
 int main(int argc, char *argv[])
 {
-    (void)argc;
-    (void)argv;
+    State state = {0};
+    state.fixed_seed = false;
+    state.game.seed = 0;
+    state.game.preview = 1;
+    state.game.clear_time = CLEAR_TIME;
+    int sim_rate = SIM_DEFAULT_RATE;
+    char *replay_path = NULL;
+    bool use_terminal = false;
+    int spectate = 0;
+    bool low_latency = false;
+    bool use_render_thread = false;
+    char *trace_path = NULL;
+    int benchmark_frames = 0;
+
+    // --seed N plays the same piece sequence every game, --preview N shows N upcoming pieces,
+    // --clear-time MS shows full rows for MS milliseconds before removing them,
+    // --sim-rate N runs the simulation at N ticks a second whatever the display does,
+    // --replay FILE plays back a recorded game in real time,
+    // --terminal also draws the game in the console, for watching over SSH,
+    // --spectate N watches N bot games at once instead of playing,
+    // --low-latency reads input just before each vblank instead of just after,
+    // --render-thread draws on its own thread, so presenting never holds up the game,
+    // --trace FILE records a timeline of frames, ticks and locks as a Chrome trace,
+    // --benchmark N lets the bot play N frames without vsync and prints what they cost.
+    for (int i = 1; i < argc; i += 1)
+    {
+        if (!strcmp(argv[i], "--terminal"))
+        {
+            use_terminal = true;
+        }
+        else if (!strcmp(argv[i], "--low-latency"))
+        {
+            low_latency = true;
+        }
+        else if (!strcmp(argv[i], "--render-thread"))
+        {
+            use_render_thread = true;
+        }
+        else if (i + 1 == argc)
+        {
+            break;
+        }
+        else if (!strcmp(argv[i], "--seed"))
+        {
+            state.game.seed = strtoull(argv[++i], NULL, 10);
+            state.fixed_seed = true;
+        }
+        else if (!strcmp(argv[i], "--preview"))
+        {
+            state.game.preview = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--clear-time"))
+        {
+            int ms = atoi(argv[++i]);
+            state.game.clear_time = ms > 0 ? (uint64_t)ms * 1000 : 0;
+        }
+        else if (!strcmp(argv[i], "--sim-rate"))
+        {
+            sim_rate = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--replay"))
+        {
+            replay_path = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--benchmark"))
+        {
+            benchmark_frames = atoi(argv[++i]);
+            if (benchmark_frames < 1)
+            {
+                fprintf(stderr, "--benchmark needs a number of frames\n");
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "--trace"))
+        {
+            trace_path = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--spectate"))
+        {
+            spectate = atoi(argv[++i]);
+            if (spectate > SPECTATE_MAX_GAMES) spectate = SPECTATE_MAX_GAMES;
+        }
+    }
+
+    // Set up before anything else depends on benchmark_frames, so a benchmark
+    // that can't run never turns into an ordinary game.
+    static Frame_Benchmark benchmark;
+    if (benchmark_frames > 0 && !benchmark_init(&benchmark, benchmark_frames))
+    {
+        fprintf(stderr, "Not enough memory to time %d frames\n", benchmark_frames);
+        return 1;
+    }
+
+    if (trace_path && !trace_start(trace_path)) fprintf(stderr, "Can't write %s\n", trace_path);
+    trace_thread_name("main");
+
+    // Everything on one thread, drawing as fast as it can, with one game.
+    if (benchmark_frames > 0)
+    {
+        benchmark_count_allocations();
+        use_render_thread = false;
+        low_latency = false;
+        spectate = 0;
+        replay_path = NULL;
+        state.fixed_seed = true;
+    }
 
 	SDL_Init(SDL_INIT_EVERYTHING);
     IMG_Init(IMG_INIT_PNG);
@@ -1095,64 +1367,225 @@ int main(int argc, char *argv[])
 			1440, 980,
 			SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
 
-	SDL_Renderer *ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-
 	TTF_Init();
-	TTF_Font *font = TTF_OpenFont("liberation.ttf", 20);
-	if (!font)
+	TTF_Font *ttf_font = TTF_OpenFont("liberation.ttf", 20);
+	if (!ttf_font)
 	{
 		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error: Font", TTF_GetError(), win);
 		return -666;
 	}
 
-    srand((unsigned int)time(0));
+    // Low latency times input against the presents, so it needs both on one
+    // thread. The spectator draws straight from its games.
+    if (low_latency || spectate > 0) use_render_thread = false;
 
-    State state;
-    state.screen = Screen_MENU;
+    state.screen = benchmark_frames > 0 ? Screen_GAME : Screen_MENU;
+    state.save_replays = benchmark_frames == 0;
     state.quit = false;
-    state.reset = true;
-    state.timer = 0;
-    state.board.score = 0;
+    state.game.reset = true;
+    state.game.timer = 0;
+    state.game.board.score = 0;
+
+    sim_clock_init(&state.clock, sim_rate);
+
+    int render_capacity = spectate > 0 ? SPECTATE_RENDER_COMMANDS : RENDER_MAX_COMMANDS + EFFECTS_MAX_PARTICLES;
+    size_t memory_length = game_memory_size() + effects_memory_size() + render_memory_size(render_capacity) + spectate_memory_size(spectate);
+    void *memory = malloc(memory_length);
+    Arena arena;
+    arena_init(&arena, memory, memory_length);
+    game_init(&state.game, &arena);
+
+    // The renderer's memory comes from the arena too. The render thread takes
+    // it before the main thread goes on, so they never use it at once.
+    static Render_Context context;
+    static Render_Snapshot snapshots[3];
+    static Render_Thread render_thread;
+    SDL_Thread *thread = NULL;
+
+    if (use_render_thread)
+    {
+        render_thread.context = &context;
+        render_thread.window = win;
+        render_thread.ttf = ttf_font;
+        render_thread.arena = &arena;
+        render_thread.capacity = render_capacity;
+        render_thread.snapshots = snapshots;
+        triple_buffer_init(&render_thread.buffer);
+        SDL_AtomicSet(&render_thread.quit, 0);
+        render_thread.ready = SDL_CreateSemaphore(0);
+
+        thread = SDL_CreateThread(render_thread_main, "render", &render_thread);
+        if (thread) SDL_SemWait(render_thread.ready);
+
+        if (!thread || !render_thread.ok)
+        {
+            SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, thread ? context.error_title : "Error: Render thread", thread ? context.error : SDL_GetError(), win);
+            return -666;
+        }
+    }
+    else if (!render_context_init(&context, win, ttf_font, &arena, render_capacity, low_latency, benchmark_frames == 0))
+    {
+        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, context.error_title, context.error, win);
+        return -666;
+    }
+
+    // Buttons only hold on to the font to draw with it.
+    gui_init(&state.gui, &context.font);
 
-    gui_init(&state.gui, font);
+    Spectator spectator = {0};
+    if (spectate > 0)
+    {
+        if (!state.fixed_seed) state.game.seed = (uint64_t)time(0);
 
-    Uint64 frame_time_start, frame_time_finish, delta_t = 0;
+        if (!spectate_init(&spectator, &arena, context.renderer, spectate, state.game.seed, state.game.clear_time))
+        {
+            SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error: Spectate", SDL_GetError(), win);
+            return -666;
+        }
+    }
+
+    if (replay_path)
+    {
+        if (!replay_load(&state.playback, replay_path))
+        {
+            SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error: Replay", replay_path, win);
+            return -666;
+        }
+
+        // Play it back at the rate it was recorded at, so every tick is as long as it was.
+        sim_clock_init(&state.clock, state.playback.rate);
+        replay_player_init(&state.player, &state.playback, &state.game);
+        state.playing = true;
+        state.screen = Screen_GAME;
+    }
+
+    static Terminal terminal;
+    if (use_terminal) terminal_begin(&terminal);
+
+    while (!state.quit && spectate > 0)
+    {
+        frame_pacer_wait(&context.pacer);
+        sim_clock_advance(&state.clock, true);
+
+        SDL_PumpEvents();
+        get_input(&state);
+
+        Uint64 dt;
+        while ((dt = sim_clock_tick(&state.clock)) != 0)
+        {
+            spectate_update(&spectator, dt);
+        }
+
+        SDL_GetWindowSize(win, &state.window.x, &state.window.y);
+        spectate_render(&context.buffer, &spectator, &context.font, state.window.x, state.window.y);
+
+        frame_pacer_rendered(&context.pacer);
+        SDL_RenderPresent(context.renderer);
+        frame_pacer_presented(&context.pacer);
+    }
+
+    static Render_Snapshot snapshot;
 
     while (!state.quit)
     {
-        frame_time_start = SDL_GetTicks();
+        if (!thread) frame_pacer_wait(&context.pacer);
+        TRACE_BEGIN(frame);
+
+        if (benchmark_frames > 0)
+        {
+            benchmark_frame_begin(&benchmark, &state.game);
+            sim_clock_add_ticks(&state.clock, 1);
+        }
+        else
+        {
+            sim_clock_advance(&state.clock, state.screen == Screen_GAME && !state.paused);
+        }
 
         gui_frame_init(&state.gui);
 
+        PROFILE_BEGIN(Profile_INPUT);
         SDL_PumpEvents();
         get_input(&state);
+        PROFILE_END(Profile_INPUT);
 
         if (!state.quit)
         {
             SDL_GetWindowSize(win, &state.window.x, &state.window.y);
 
+            PROFILE_BEGIN(Profile_UPDATE);
             if (state.screen == Screen_GAME)
             {
-                update_game(&state, delta_t);
-                render_game(ren, state, font);
+                update_game(&state);
             }
             else
             {
                 update_menu(&state);
-                render_menu(ren, state, font);
             }
+            PROFILE_END(Profile_UPDATE);
+
+            if (thread)
+            {
+                PROFILE_BEGIN(Profile_SNAPSHOT);
+                take_snapshot(&state, &snapshots[triple_buffer_back(&render_thread.buffer)]);
+                triple_buffer_publish(&render_thread.buffer);
+                PROFILE_END(Profile_SNAPSHOT);
+            }
+            else
+            {
+                PROFILE_BEGIN(Profile_SNAPSHOT);
+                take_snapshot(&state, &snapshot);
+                PROFILE_END(Profile_SNAPSHOT);
+
+                render(&context, &snapshot);
+            }
+
+            // After the present, to keep the write off the way to the screen.
+            if (use_terminal && state.screen == Screen_GAME) terminal_draw_game(&terminal, &state.game);
 
-            /*
-            update(&state, delta_t);
-            render(ren, state, font);
-            */
+            TRACE_END(frame);
 
-            frame_time_finish = SDL_GetTicks();
-            delta_t = frame_time_finish - frame_time_start;
+            if (benchmark_frames > 0 && benchmark_frame_end(&benchmark)) state.quit = true;
+
+            // Nothing here waits for vblank any more. Check for input and due
+            // ticks about once a millisecond.
+            if (thread) SDL_Delay(1);
+        }
+        else
+        {
+            // Quitting skips the rest of the frame. Close its span anyway.
+            TRACE_END(frame);
         }
     }
 
-	SDL_DestroyRenderer(ren);
+    if (benchmark_frames > 0)
+    {
+        benchmark_report(&benchmark, context.renderer, &state.game);
+        benchmark_free_frames(&benchmark);
+    }
+
+    spectate_free(&spectator);
+
+    if (thread)
+    {
+        SDL_AtomicSet(&render_thread.quit, 1);
+        SDL_WaitThread(thread, NULL);
+        SDL_DestroySemaphore(render_thread.ready);
+    }
+    else
+    {
+        render_context_free(&context);
+    }
+
+    if (use_terminal) terminal_end(&terminal);
+
+    finish_recording(&state);
+    replay_free(&state.recording);
+    replay_free(&state.playback);
+    free(memory);
+
+    trace_stop();
+
+    TTF_CloseFont(ttf_font);
 	SDL_DestroyWindow(win);
 	SDL_Quit();
     return 0;
@@ -0,0 +1,200 @@
+// Threads, atomics and a clock for the parts of the game that run without SDL.
+// Linux/POSIX and Windows. On Linux, define _GNU_SOURCE before the system
+// headers so threads can be pinned to cores.
+
+#define CACHE_LINE 64
+
+#ifdef _WIN32
+#include <windows.h>
+
+typedef struct {
+    HANDLE handle;
+} Thread;
+
+typedef int (*Thread_Proc)(void *data);
+
+typedef struct {
+    Thread_Proc proc;
+    void *data;
+} Thread_Start;
+
+static DWORD WINAPI thread_trampoline(LPVOID parameter)
+{
+    Thread_Start start = *(Thread_Start *)parameter;
+    free(parameter);
+    return (DWORD)start.proc(start.data);
+}
+
+bool thread_start(Thread *thread, Thread_Proc proc, void *data)
+{
+    Thread_Start *start = malloc(sizeof(Thread_Start));
+    start->proc = proc;
+    start->data = data;
+
+    thread->handle = CreateThread(NULL, 0, thread_trampoline, start, 0, NULL);
+    return thread->handle != NULL;
+}
+
+void thread_join(Thread *thread)
+{
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+}
+
+void thread_yield(void)
+{
+    SwitchToThread();
+}
+
+void sleep_us(uint64_t us)
+{
+    Sleep((DWORD)(us / 1000));
+}
+
+// Pin the calling thread to one core.
+void thread_pin_to_core(int core)
+{
+    SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << (core % (int)(sizeof(DWORD_PTR) * 8)));
+}
+
+int cpu_count(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+}
+
+static inline uint64_t atomic_load_u64(volatile uint64_t *p)
+{
+    return (uint64_t)InterlockedCompareExchange64((volatile LONG64 *)p, 0, 0);
+}
+
+static inline bool atomic_compare_swap_u64(volatile uint64_t *p, uint64_t expected, uint64_t desired)
+{
+    return (uint64_t)InterlockedCompareExchange64((volatile LONG64 *)p, (LONG64)desired, (LONG64)expected) == expected;
+}
+
+static inline uint64_t atomic_add_u64(volatile uint64_t *p, uint64_t value)
+{
+    return (uint64_t)InterlockedExchangeAdd64((volatile LONG64 *)p, (LONG64)value) + value;
+}
+
+uint64_t time_now_us(void)
+{
+    static LARGE_INTEGER frequency;
+    if (!frequency.QuadPart) QueryPerformanceFrequency(&frequency);
+
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart * 1000000 +
+                      counter.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart);
+}
+
+uint64_t time_now_ns(void)
+{
+    static LARGE_INTEGER frequency;
+    if (!frequency.QuadPart) QueryPerformanceFrequency(&frequency);
+
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart * 1000000000 +
+                      counter.QuadPart % frequency.QuadPart * 1000000000 / frequency.QuadPart);
+}
+
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+typedef struct {
+    pthread_t handle;
+} Thread;
+
+typedef int (*Thread_Proc)(void *data);
+
+typedef struct {
+    Thread_Proc proc;
+    void *data;
+} Thread_Start;
+
+static void *thread_trampoline(void *parameter)
+{
+    Thread_Start start = *(Thread_Start *)parameter;
+    free(parameter);
+    start.proc(start.data);
+    return NULL;
+}
+
+bool thread_start(Thread *thread, Thread_Proc proc, void *data)
+{
+    Thread_Start *start = malloc(sizeof(Thread_Start));
+    start->proc = proc;
+    start->data = data;
+
+    return pthread_create(&thread->handle, NULL, thread_trampoline, start) == 0;
+}
+
+void thread_join(Thread *thread)
+{
+    pthread_join(thread->handle, NULL);
+}
+
+void thread_yield(void)
+{
+    sched_yield();
+}
+
+void sleep_us(uint64_t us)
+{
+    struct timespec duration = {(time_t)(us / 1000000), (long)(us % 1000000) * 1000};
+    nanosleep(&duration, NULL);
+}
+
+// Pin the calling thread to one core.
+void thread_pin_to_core(int core)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core % CPU_SETSIZE, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)core;
+#endif
+}
+
+int cpu_count(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+static inline uint64_t atomic_load_u64(volatile uint64_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline bool atomic_compare_swap_u64(volatile uint64_t *p, uint64_t expected, uint64_t desired)
+{
+    return __atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static inline uint64_t atomic_add_u64(volatile uint64_t *p, uint64_t value)
+{
+    return __atomic_add_fetch(p, value, __ATOMIC_ACQ_REL);
+}
+
+uint64_t time_now_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+uint64_t time_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+#endif
@@ -0,0 +1,89 @@
+// A fixed number of same-sized items carved out of an arena, handed out and
+// given back through a free list, so a pool never grows however long it's used.
+//
+// Items are referred to by handle: the slot index in the low 16 bits and the
+// slot's generation in the high 16. The generation goes up every time a slot
+// is handed out or given back (odd while it's in use), so a handle to an item
+// that has since been given back no longer resolves. 0 is never a valid handle.
+
+typedef uint32_t Handle;
+
+typedef struct {
+    uint8_t *items;
+    size_t item_size;
+
+    uint16_t *generations;
+    int *next_free;
+
+    int capacity;
+    int free_list;
+    int count;
+} Pool;
+
+size_t pool_memory_size(int capacity, size_t item_size)
+{
+    return (size_t)capacity * (item_size + sizeof(uint16_t) + sizeof(int)) + 2 * sizeof(void *);
+}
+
+// Put every slot back on the free list. Outstanding handles stop resolving.
+void pool_clear(Pool *pool)
+{
+    for (int i = 0; i < pool->capacity; i += 1)
+    {
+        if (pool->generations[i] & 1) pool->generations[i] += 1;
+        pool->next_free[i] = i + 1 < pool->capacity ? i + 1 : -1;
+    }
+
+    pool->free_list = pool->capacity > 0 ? 0 : -1;
+    pool->count = 0;
+}
+
+// capacity has to fit in 16 bits. Returns false if the arena is out of room.
+bool pool_init(Pool *pool, Arena *arena, int capacity, size_t item_size)
+{
+    pool->item_size = item_size;
+    pool->capacity = capacity;
+
+    pool->items       = arena_alloc_aligned(arena, (size_t)capacity * item_size, sizeof(void *));
+    pool->next_free   = arena_alloc_aligned(arena, (size_t)capacity * sizeof(int), sizeof(int));
+    pool->generations = arena_alloc(arena, (size_t)capacity * sizeof(uint16_t));
+    if (!pool->items || !pool->next_free || !pool->generations) return false;
+
+    pool_clear(pool);
+    return true;
+}
+
+// Hand out a zeroed item. Returns 0 if the pool is full.
+Handle pool_acquire(Pool *pool)
+{
+    int index = pool->free_list;
+    if (index < 0) return 0;
+
+    pool->free_list = pool->next_free[index];
+    pool->generations[index] += 1;
+    pool->count += 1;
+
+    memset(pool->items + (size_t)index * pool->item_size, 0, pool->item_size);
+    return ((Handle)pool->generations[index] << 16) | (Handle)index;
+}
+
+// The item behind a handle, or NULL if the handle is 0 or out of date.
+static inline void *pool_get(Pool *pool, Handle handle)
+{
+    int index = (int)(handle & 0xFFFF);
+    uint16_t generation = (uint16_t)(handle >> 16);
+
+    if (!(generation & 1) || index >= pool->capacity || pool->generations[index] != generation) return NULL;
+    return pool->items + (size_t)index * pool->item_size;
+}
+
+void pool_release(Pool *pool, Handle handle)
+{
+    if (!pool_get(pool, handle)) return;
+
+    int index = (int)(handle & 0xFFFF);
+    pool->generations[index] += 1;
+    pool->next_free[index] = pool->free_list;
+    pool->free_list = index;
+    pool->count -= 1;
+}
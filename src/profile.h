@@ -0,0 +1,144 @@
+// Timers for the phases of a frame, to see where frame time goes without
+// attaching a profiler. Each phase keeps its last PROFILE_SAMPLES times in a
+// ring, and the overlay (F4) shows the median, the 99th percentile and the
+// worst of them. With NDEBUG all of it compiles to nothing.
+//
+// A phase is only ever timed from one thread. With --render-thread the
+// overlay reads the main thread's rings without locking, which at worst
+// shows a sample a frame late.
+
+#ifndef NDEBUG
+#define PROFILE_ENABLED
+#endif
+
+#define PROFILE_SAMPLES 256
+
+typedef enum {
+    Profile_FRAME,
+    Profile_INPUT,
+    Profile_UPDATE,
+    Profile_SNAPSHOT,
+    Profile_PARTICLES,
+    Profile_BOARD_CACHE,
+    Profile_BOARD,
+    Profile_PIECES,
+    Profile_DRAW_PARTICLES,
+    Profile_HUD,
+    Profile_FLUSH,
+    Profile_PRESENT,
+    Profile_COUNT,
+} Profile_Phase;
+
+#ifdef PROFILE_ENABLED
+
+static const char *profile_names[Profile_COUNT] = {
+    [Profile_FRAME]          = "frame",
+    [Profile_INPUT]          = "input",
+    [Profile_UPDATE]         = "update",
+    [Profile_SNAPSHOT]       = "snapshot",
+    [Profile_PARTICLES]      = "particles",
+    [Profile_BOARD_CACHE]    = "board cache",
+    [Profile_BOARD]          = "board",
+    [Profile_PIECES]         = "pieces",
+    [Profile_DRAW_PARTICLES] = "draw particles",
+    [Profile_HUD]            = "hud",
+    [Profile_FLUSH]          = "flush",
+    [Profile_PRESENT]        = "present",
+};
+
+typedef struct {
+    // Performance counter ticks, the newest at next - 1.
+    Uint64 samples[Profile_COUNT][PROFILE_SAMPLES];
+    int next[Profile_COUNT];
+    int count[Profile_COUNT];
+} Profile;
+
+Profile profile;
+
+// Put a phase between these, in the same block.
+#define PROFILE_BEGIN(phase) Uint64 profile_start_##phase = SDL_GetPerformanceCounter()
+#define PROFILE_END(phase)   profile_record(phase, SDL_GetPerformanceCounter() - profile_start_##phase)
+
+// For times measured some other way.
+#define PROFILE_RECORD(phase, ticks) profile_record(phase, ticks)
+
+void profile_record(Profile_Phase phase, Uint64 ticks)
+{
+    profile.samples[phase][profile.next[phase]] = ticks;
+    profile.next[phase] = (profile.next[phase] + 1) % PROFILE_SAMPLES;
+    if (profile.count[phase] < PROFILE_SAMPLES) profile.count[phase] += 1;
+}
+
+static int profile_compare(const void *a, const void *b)
+{
+    Uint64 x = *(const Uint64 *)a;
+    Uint64 y = *(const Uint64 *)b;
+    return (x > y) - (x < y);
+}
+
+// Milliseconds at the 50th and 99th percentile, and the most, of the samples
+// in the ring. Returns false if the phase hasn't been timed yet.
+bool profile_stats(Profile_Phase phase, double *p50, double *p99, double *max)
+{
+    int count = profile.count[phase];
+    if (count == 0) return false;
+
+    Uint64 sorted[PROFILE_SAMPLES];
+    memcpy(sorted, profile.samples[phase], (size_t)count * sizeof(Uint64));
+    qsort(sorted, (size_t)count, sizeof(Uint64), profile_compare);
+
+    double ms = 1000.0 / (double)SDL_GetPerformanceFrequency();
+    *p50 = (double)sorted[count / 2] * ms;
+    *p99 = (double)sorted[(count * 99) / 100] * ms;
+    *max = (double)sorted[count - 1] * ms;
+    return true;
+}
+
+// A table of every phase with its top right corner at x, y.
+void profile_draw(Render_Buffer *r, Font *font, int x, int y)
+{
+    int column = 70;
+    int line = font->height;
+    x -= 140 + 3*column;
+
+    SDL_Rect background = {x - 8, y, 140 + 3*column + 8, (Profile_COUNT + 1)*line + 8};
+    render_set_layer(r, Layer_MENU);
+    render_set_color(r, 15, 15, 15, 255);
+    render_fill_rect(r, &background);
+
+    render_set_layer(r, Layer_BUTTON_TEXT);
+    SDL_Color color = {225, 225, 225, 255};
+    char buf[50];
+
+    y += 4;
+    draw_text(r, x, y, "ms", font, color);
+    draw_text(r, x + 140, y, "p50", font, color);
+    draw_text(r, x + 140 + column, y, "p99", font, color);
+    draw_text(r, x + 140 + 2*column, y, "max", font, color);
+
+    for (int i = 0; i < Profile_COUNT; i += 1)
+    {
+        y += line;
+
+        double p50, p99, max;
+        if (!profile_stats((Profile_Phase)i, &p50, &p99, &max)) continue;
+
+        draw_text(r, x, y, (char *)profile_names[i], font, color);
+
+        sprintf_s(buf, 50, "%.3f", p50);
+        draw_text(r, x + 140, y, buf, font, color);
+        sprintf_s(buf, 50, "%.3f", p99);
+        draw_text(r, x + 140 + column, y, buf, font, color);
+        sprintf_s(buf, 50, "%.3f", max);
+        draw_text(r, x + 140 + 2*column, y, buf, font, color);
+    }
+}
+
+#else
+
+#define PROFILE_BEGIN(phase)
+#define PROFILE_END(phase)           ((void)0)
+#define PROFILE_RECORD(phase, ticks) ((void)0)
+#define profile_draw(r, font, x, y)  ((void)0)
+
+#endif
@@ -0,0 +1,133 @@
+// Seeded piece sequences. Every game owns its own generator, so the same seed
+// always deals the same pieces, on any thread.
+//
+// The generator is xoshiro128** seeded through splitmix64. Pieces come from a
+// 7-bag: each run of seven is a shuffled copy of all seven tetronimos, as
+// piece types 1 to 7. Include before game.h.
+
+#define RANDOMIZER_MAX_PREVIEW 6
+
+typedef struct {
+    uint32_t s[4];
+} Random;
+
+typedef struct {
+    Random random;
+    uint64_t seed;
+
+    uint8_t bag[7];
+    int bag_index;
+
+    // Upcoming pieces, queue[0] is the next one to spawn.
+    uint8_t queue[RANDOMIZER_MAX_PREVIEW + 1];
+    int preview;
+} Randomizer;
+
+static inline uint64_t splitmix64(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+void random_seed(Random *r, uint64_t seed)
+{
+    uint64_t a = splitmix64(&seed);
+    uint64_t b = splitmix64(&seed);
+
+    r->s[0] = (uint32_t)a;
+    r->s[1] = (uint32_t)(a >> 32);
+    r->s[2] = (uint32_t)b;
+    r->s[3] = (uint32_t)(b >> 32);
+}
+
+static inline uint32_t random_rotl(uint32_t x, int k)
+{
+    return (x << k) | (x >> (32 - k));
+}
+
+static inline uint32_t random_next(Random *r)
+{
+    uint32_t *s = r->s;
+    uint32_t result = random_rotl(s[1] * 5, 7) * 9;
+    uint32_t t = s[1] << 9;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = random_rotl(s[3], 11);
+
+    return result;
+}
+
+// Uniform in [0, n), without modulo bias.
+static inline uint32_t random_below(Random *r, uint32_t n)
+{
+    uint32_t threshold = (0u - n) % n;
+
+    for (;;)
+    {
+        uint32_t x = random_next(r);
+        if (x >= threshold) return x % n;
+    }
+}
+
+void randomizer_fill_bag(Randomizer *z)
+{
+    for (int i = 0; i < 7; i += 1)
+    {
+        z->bag[i] = (uint8_t)(i + 1);
+    }
+
+    for (int i = 6; i > 0; i -= 1)
+    {
+        int j = (int)random_below(&z->random, (uint32_t)(i + 1));
+        uint8_t temp = z->bag[i];
+        z->bag[i] = z->bag[j];
+        z->bag[j] = temp;
+    }
+
+    z->bag_index = 0;
+}
+
+static inline uint8_t randomizer_draw(Randomizer *z)
+{
+    if (z->bag_index >= 7) randomizer_fill_bag(z);
+    return z->bag[z->bag_index++];
+}
+
+// preview is how many upcoming pieces can be peeked at, up to RANDOMIZER_MAX_PREVIEW.
+void randomizer_init(Randomizer *z, uint64_t seed, int preview)
+{
+    if (preview < 1) preview = 1;
+    if (preview > RANDOMIZER_MAX_PREVIEW) preview = RANDOMIZER_MAX_PREVIEW;
+
+    random_seed(&z->random, seed);
+    z->seed = seed;
+    z->preview = preview;
+    z->bag_index = 7;
+
+    for (int i = 0; i < preview; i += 1)
+    {
+        z->queue[i] = randomizer_draw(z);
+    }
+}
+
+// The i-th upcoming piece, 0 being the next to spawn.
+static inline int randomizer_peek(Randomizer *z, int i)
+{
+    return z->queue[i];
+}
+
+int randomizer_next(Randomizer *z)
+{
+    int next = z->queue[0];
+
+    memmove(&z->queue[0], &z->queue[1], (size_t)(z->preview - 1));
+    z->queue[z->preview - 1] = randomizer_draw(z);
+
+    return next;
+}
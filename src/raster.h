@@ -0,0 +1,395 @@
+// A software renderer for machines without a display: draws the same things
+// as render_game into an RGBA buffer in memory, and writes it out as PNG or
+// PPM. Rect fills write four pixels per SSE2 store. Text uses a small
+// built-in bitmap font, so there's no dependency on SDL_ttf either.
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define RASTER_SSE2 1
+#endif
+
+typedef struct {
+    // RGBA bytes in memory order, rows top to bottom.
+    uint32_t *pixels;
+    int width;
+    int height;
+} Image;
+
+// Where things go in a frame, in cells: HUD on the left, then the board, then the preview.
+#define RASTER_HUD_CELLS     5
+#define RASTER_PREVIEW_CELLS 5
+
+static inline uint32_t raster_pixel(Color c)
+{
+    uint8_t bytes[4] = {c.r, c.g, c.b, c.a};
+    uint32_t pixel;
+    memcpy(&pixel, bytes, 4);
+    return pixel;
+}
+
+// The image size for a given cell size.
+void raster_frame_size(int cell_size, int *width, int *height)
+{
+    *width = (RASTER_HUD_CELLS + BOARD_WIDTH + RASTER_PREVIEW_CELLS) * cell_size;
+    *height = BOARD_HEIGHT * cell_size;
+}
+
+void raster_fill_rect(Image *image, int x, int y, int w, int h, Color color)
+{
+    int x0 = x < 0 ? 0 : x;
+    int y0 = y < 0 ? 0 : y;
+    int x1 = x + w > image->width ? image->width : x + w;
+    int y1 = y + h > image->height ? image->height : y + h;
+    if (x0 >= x1 || y0 >= y1) return;
+
+    uint32_t pixel = raster_pixel(color);
+
+#ifdef RASTER_SSE2
+    __m128i four = _mm_set1_epi32((int)pixel);
+#endif
+
+    for (int row = y0; row < y1; row += 1)
+    {
+        uint32_t *p = image->pixels + (size_t)row * (size_t)image->width + x0;
+        int n = x1 - x0;
+
+#ifdef RASTER_SSE2
+        for (; n >= 4; n -= 4, p += 4)
+        {
+            _mm_storeu_si128((__m128i *)p, four);
+        }
+#endif
+
+        for (; n > 0; n -= 1, p += 1)
+        {
+            *p = pixel;
+        }
+    }
+}
+
+// 5x7 glyphs, one byte per row with the leftmost pixel in bit 4. Lower case
+// letters are drawn as upper case, anything else missing is left blank.
+static const uint8_t raster_font_digits[10][7] = {
+    {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E},
+    {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E},
+    {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F},
+    {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E},
+    {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02},
+    {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E},
+    {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E},
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08},
+    {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E},
+    {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C},
+};
+
+static const uint8_t raster_font_letters[26][7] = {
+    {0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11},
+    {0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E},
+    {0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E},
+    {0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C},
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F},
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10},
+    {0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F},
+    {0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11},
+    {0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E},
+    {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C},
+    {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11},
+    {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F},
+    {0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11},
+    {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11},
+    {0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E},
+    {0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10},
+    {0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D},
+    {0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11},
+    {0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E},
+    {0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04},
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E},
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04},
+    {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A},
+    {0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11},
+    {0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04},
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F},
+};
+
+static const uint8_t raster_font_period[7] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C};
+static const uint8_t raster_font_colon[7]  = {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00};
+
+static const uint8_t *raster_glyph(char c)
+{
+    if (c >= '0' && c <= '9') return raster_font_digits[c - '0'];
+    if (c >= 'A' && c <= 'Z') return raster_font_letters[c - 'A'];
+    if (c >= 'a' && c <= 'z') return raster_font_letters[c - 'a'];
+    if (c == '.') return raster_font_period;
+    if (c == ':') return raster_font_colon;
+    return NULL;
+}
+
+// Text with its top left at x, y. Each font pixel is scale by scale image pixels.
+void raster_text(Image *image, int x, int y, int scale, char *string, Color color)
+{
+    for (char *c = string; *c; c += 1)
+    {
+        const uint8_t *glyph = raster_glyph(*c);
+
+        for (int row = 0; glyph && row < 7; row += 1)
+        {
+            for (int column = 0; column < 5; column += 1)
+            {
+                if (glyph[row] & (0x10 >> column))
+                {
+                    raster_fill_rect(image, x + column * scale, y + row * scale, scale, scale, color);
+                }
+            }
+        }
+
+        x += 6 * scale;
+    }
+}
+
+static void raster_cell(Image *image, int x, int y, int cell_size, int padding, Color color)
+{
+    raster_fill_rect(image, x + padding, y + padding, cell_size - 2*padding, cell_size - 2*padding, color);
+}
+
+static void raster_tetronimo(Image *image, Tetronimo *t, int origin_x, int origin_y, int cell_size, int padding, Color color)
+{
+    const uint16_t *shape = get_shape(t);
+
+    for (int j = 0; j < 4; j += 1)
+    {
+        for (int i = 0; i < 4; i += 1)
+        {
+            if (shape[j] & (1 << i))
+            {
+                raster_cell(image, origin_x + (t->x + i) * cell_size, origin_y + (t->y + j) * cell_size, cell_size, padding, color);
+            }
+        }
+    }
+}
+
+// Draw a frame of the game. The image has to be raster_frame_size big.
+void raster_game(Image *image, Game *g, int cell_size)
+{
+    Board *b = &g->board;
+    int padding = cell_size / 50;
+    int board_x = RASTER_HUD_CELLS * cell_size;
+    int preview_x = board_x + (BOARD_WIDTH + 1) * cell_size;
+    int scale = cell_size / 8 > 0 ? cell_size / 8 : 1;
+
+    raster_fill_rect(image, 0, 0, image->width, image->height, (Color){0, 0, 0, 255});
+    raster_fill_rect(image, board_x, 0, BOARD_WIDTH * cell_size, BOARD_HEIGHT * cell_size, (Color){35, 35, 35, 255});
+
+    // Locked cells, white while they wait to be cleared.
+    for (int row = 0; row < b->height; row += 1)
+    {
+        uint16_t bits = b->rows[row];
+        if (!bits) continue;
+
+        bool clearing = (b->rows_to_clear & (1u << row)) != 0;
+
+        for (int column = 0; column < b->width; column += 1)
+        {
+            if (!(bits & (1 << column))) continue;
+
+            Color color = clearing ? (Color){255, 255, 255, 255} : get_color((Tetronimo_Type)b->cell_types[get_2d_index(column, row, b->width)]);
+            raster_cell(image, board_x + column * cell_size, row * cell_size, cell_size, padding, color);
+        }
+    }
+
+    Tetronimo *t = get_active(b);
+    if (t)
+    {
+        Color color = get_color(t->type);
+        Color ghost_color = {(uint8_t)(color.r/5), (uint8_t)(color.g/5), (uint8_t)(color.b/5), 255};
+
+        Tetronimo ghost = *t;
+        ghost.y = b->ghost_y;
+        raster_tetronimo(image, &ghost, board_x, 0, cell_size, 0, ghost_color);
+        raster_tetronimo(image, t, board_x, 0, cell_size, padding, color);
+    }
+
+    for (int p = 0; p < b->randomizer.preview; p += 1)
+    {
+        Tetronimo next = make_tetronimo((Tetronimo_Type)randomizer_peek(&b->randomizer, p), 0, 0);
+        raster_tetronimo(image, &next, preview_x, (BOARD_HEIGHT/4 - 2 + 3*p) * cell_size, cell_size, padding, get_color(next.type));
+    }
+
+    // Score and time.
+    char buf[50];
+    Color text_color = {225, 225, 225, 255};
+
+    snprintf(buf, 50, "%d", b->score);
+    raster_text(image, cell_size / 2, BOARD_HEIGHT/4 * cell_size, scale, buf, text_color);
+
+    snprintf(buf, 50, "%llu.%03llu", (unsigned long long)(g->timer / 1000000), (unsigned long long)(g->timer / 1000 % 1000));
+    raster_text(image, cell_size / 2, BOARD_HEIGHT/4 * cell_size + 10 * scale, scale, buf, text_color);
+}
+
+static FILE *raster_open(const char *path)
+{
+#ifdef _MSC_VER
+    FILE *file = NULL;
+    if (fopen_s(&file, path, "wb")) return NULL;
+    return file;
+#else
+    return fopen(path, "wb");
+#endif
+}
+
+bool image_write_ppm(Image *image, const char *path)
+{
+    FILE *file = raster_open(path);
+    if (!file) return false;
+
+    fprintf(file, "P6\n%d %d\n255\n", image->width, image->height);
+
+    size_t row_size = (size_t)image->width * 3;
+    uint8_t *row = malloc(row_size);
+    bool ok = true;
+
+    for (int y = 0; y < image->height && ok; y += 1)
+    {
+        uint8_t *rgba = (uint8_t *)(image->pixels + (size_t)y * (size_t)image->width);
+        for (int x = 0; x < image->width; x += 1)
+        {
+            row[x*3 + 0] = rgba[x*4 + 0];
+            row[x*3 + 1] = rgba[x*4 + 1];
+            row[x*3 + 2] = rgba[x*4 + 2];
+        }
+
+        ok = fwrite(row, 1, row_size, file) == row_size;
+    }
+
+    free(row);
+    fclose(file);
+    return ok;
+}
+
+static uint32_t raster_crc_table[256];
+
+static uint32_t raster_crc(uint32_t crc, const uint8_t *data, size_t length)
+{
+    if (!raster_crc_table[1])
+    {
+        for (uint32_t n = 0; n < 256; n += 1)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k += 1) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            raster_crc_table[n] = c;
+        }
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < length; i += 1)
+    {
+        crc = raster_crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+static void raster_put_u32(uint8_t *p, uint32_t value)
+{
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)value;
+}
+
+static bool raster_write_chunk(FILE *file, const char *type, const uint8_t *data, uint32_t length)
+{
+    uint8_t header[8];
+    raster_put_u32(header, length);
+    memcpy(header + 4, type, 4);
+
+    uint8_t footer[4];
+    raster_put_u32(footer, raster_crc(raster_crc(0, header + 4, 4), data, length));
+
+    return fwrite(header, 1, 8, file) == 8 &&
+           fwrite(data, 1, length, file) == length &&
+           fwrite(footer, 1, 4, file) == 4;
+}
+
+// An RGBA PNG. The pixels go in uncompressed (stored deflate blocks), which
+// costs file size but no time.
+bool image_write_png(Image *image, const char *path)
+{
+    size_t row_size = 1 + (size_t)image->width * 4;
+    size_t raw_size = row_size * (size_t)image->height;
+    size_t blocks = (raw_size + 65534) / 65535;
+    size_t zlib_size = 2 + raw_size + 5 * blocks + 4;
+
+    uint8_t *zlib = malloc(zlib_size);
+    uint8_t *out = zlib;
+
+    *out++ = 0x78;
+    *out++ = 0x01;
+
+    // Walk the filtered rows (a 0 filter byte, then the row) block by block.
+    uint32_t a = 1;
+    uint32_t b = 0;
+    size_t done = 0;
+
+    for (size_t block = 0; block < blocks; block += 1)
+    {
+        size_t length = raw_size - done < 65535 ? raw_size - done : 65535;
+
+        *out++ = block + 1 == blocks ? 1 : 0;
+        *out++ = (uint8_t)length;
+        *out++ = (uint8_t)(length >> 8);
+        *out++ = (uint8_t)~length;
+        *out++ = (uint8_t)(~length >> 8);
+
+        for (size_t i = 0; i < length; i += 1)
+        {
+            size_t offset = done + i;
+            size_t y = offset / row_size;
+            size_t x = offset % row_size;
+
+            uint8_t byte = x == 0 ? 0 : ((uint8_t *)(image->pixels + y * (size_t)image->width))[x - 1];
+            *out++ = byte;
+
+            a = (a + byte) % 65521;
+            b = (b + a) % 65521;
+        }
+
+        done += length;
+    }
+
+    raster_put_u32(out, (b << 16) | a);
+
+    uint8_t ihdr[13];
+    raster_put_u32(ihdr, (uint32_t)image->width);
+    raster_put_u32(ihdr + 4, (uint32_t)image->height);
+    ihdr[8] = 8;  // Bits per channel.
+    ihdr[9] = 6;  // RGBA.
+    ihdr[10] = 0;
+    ihdr[11] = 0;
+    ihdr[12] = 0;
+
+    bool ok = false;
+    FILE *file = raster_open(path);
+
+    if (file)
+    {
+        static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+        ok = fwrite(signature, 1, 8, file) == 8 &&
+             raster_write_chunk(file, "IHDR", ihdr, 13) &&
+             raster_write_chunk(file, "IDAT", zlib, (uint32_t)zlib_size) &&
+             raster_write_chunk(file, "IEND", NULL, 0);
+
+        fclose(file);
+    }
+
+    free(zlib);
+    return ok;
+}
+
+// PPM if the path ends in .ppm, PNG otherwise.
+bool image_write(Image *image, const char *path)
+{
+    size_t length = strlen(path);
+    if (length >= 4 && !strcmp(path + length - 4, ".ppm")) return image_write_ppm(image, path);
+    return image_write_png(image, path);
+}
@@ -0,0 +1,233 @@
+// A render command buffer. Drawing code sets a layer and a color like it would
+// on the SDL_Renderer and appends rects, points and texture copies. Nothing
+// reaches SDL until render_flush. The flush sorts the commands by layer, kind,
+// texture and color, keeping the order they were added within each group. It
+// then submits each run with one color change and one SDL_RenderFillRects or
+// SDL_RenderDrawPoints call.
+//
+// Only the layer order is kept on screen, so anything that overlaps has to go
+// on a later layer.
+
+// Plenty for a frame of the game. Views that draw more pass their own capacity to render_init.
+#define RENDER_MAX_COMMANDS 8192
+#define RENDER_MAX_TEXTURES 16
+
+typedef enum {
+    Layer_BOARD,
+    Layer_CELLS,
+    Layer_GHOST,
+    Layer_PIECE,
+    Layer_EFFECTS,
+    Layer_HUD,
+    Layer_MENU,
+    Layer_BUTTON_SHADOW,
+    Layer_BUTTON,
+    Layer_BUTTON_TEXT,
+} Render_Layer;
+
+typedef enum {
+    Command_RECT,
+    Command_POINT,
+    Command_TEXTURE,
+} Command_Kind;
+
+typedef struct {
+    // layer, kind, texture slot and color packed so one compare sorts them,
+    // then sequence keeps the submission order.
+    uint64_t key;
+    uint32_t sequence;
+
+    SDL_Rect rect;
+    SDL_Rect source;
+} Render_Command;
+
+typedef struct {
+    SDL_Renderer *renderer;
+
+    Render_Command *commands;
+    int count;
+    int capacity;
+
+    // Scratch space for batching runs at flush time.
+    SDL_Rect *rects;
+    SDL_Point *points;
+
+    SDL_Texture *textures[RENDER_MAX_TEXTURES];
+    int texture_count;
+
+    // Current state, like SDL's draw color.
+    Render_Layer layer;
+    SDL_Color color;
+
+    // Commands and SDL calls in the last flush.
+    int submitted;
+    int draw_calls;
+
+    // Commands thrown away because the buffer was full, since startup.
+    int dropped;
+} Render_Buffer;
+
+size_t render_memory_size(int capacity)
+{
+    return (size_t)capacity * (sizeof(Render_Command) + sizeof(SDL_Rect) + sizeof(SDL_Point)) + 3 * sizeof(uint64_t);
+}
+
+// The arena needs render_memory_size(capacity) bytes free.
+void render_init(Render_Buffer *r, Arena *arena, SDL_Renderer *renderer, int capacity)
+{
+    r->renderer = renderer;
+    r->capacity = capacity;
+    r->commands = arena_alloc_aligned(arena, (size_t)capacity * sizeof(Render_Command), sizeof(uint64_t));
+    r->rects    = arena_alloc_aligned(arena, (size_t)capacity * sizeof(SDL_Rect), sizeof(uint64_t));
+    r->points   = arena_alloc_aligned(arena, (size_t)capacity * sizeof(SDL_Point), sizeof(uint64_t));
+    r->count = 0;
+    r->texture_count = 0;
+    r->dropped = 0;
+    r->layer = Layer_BOARD;
+    r->color = (SDL_Color){255, 255, 255, 255};
+}
+
+void render_set_layer(Render_Buffer *r, Render_Layer layer)
+{
+    r->layer = layer;
+}
+
+void render_set_color(Render_Buffer *r, Uint8 red, Uint8 green, Uint8 blue, Uint8 alpha)
+{
+    r->color = (SDL_Color){red, green, blue, alpha};
+}
+
+static int render_texture_slot(Render_Buffer *r, SDL_Texture *texture)
+{
+    for (int i = 0; i < r->texture_count; i += 1)
+    {
+        if (r->textures[i] == texture) return i;
+    }
+
+    if (r->texture_count == RENDER_MAX_TEXTURES) return -1;
+
+    r->textures[r->texture_count] = texture;
+    return r->texture_count++;
+}
+
+static Render_Command *render_push(Render_Buffer *r, Command_Kind kind, int texture_slot)
+{
+    if (r->count == r->capacity)
+    {
+        r->dropped += 1;
+        return NULL;
+    }
+
+    Render_Command *c = &r->commands[r->count];
+    c->key = ((uint64_t)r->layer << 56) |
+             ((uint64_t)kind << 48) |
+             ((uint64_t)texture_slot << 40) |
+             ((uint64_t)r->color.r << 24) | ((uint64_t)r->color.g << 16) | ((uint64_t)r->color.b << 8) | r->color.a;
+    c->sequence = (uint32_t)r->count;
+    r->count += 1;
+
+    return c;
+}
+
+void render_fill_rect(Render_Buffer *r, SDL_Rect *rect)
+{
+    Render_Command *c = render_push(r, Command_RECT, 0);
+    if (c) c->rect = *rect;
+}
+
+void render_point(Render_Buffer *r, int x, int y)
+{
+    Render_Command *c = render_push(r, Command_POINT, 0);
+    if (c) c->rect = (SDL_Rect){x, y, 1, 1};
+}
+
+// Copy part of a texture, tinted with the current color through the texture's color and alpha mod.
+void render_copy(Render_Buffer *r, SDL_Texture *texture, SDL_Rect *source, SDL_Rect *dest)
+{
+    int slot = render_texture_slot(r, texture);
+    if (slot < 0)
+    {
+        r->dropped += 1;
+        return;
+    }
+
+    Render_Command *c = render_push(r, Command_TEXTURE, slot);
+    if (!c) return;
+
+    c->rect = *dest;
+    c->source = *source;
+}
+
+static int render_compare(const void *a, const void *b)
+{
+    const Render_Command *x = a;
+    const Render_Command *y = b;
+
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    return x->sequence < y->sequence ? -1 : (x->sequence > y->sequence);
+}
+
+// Submit everything appended since the last flush.
+void render_flush(Render_Buffer *r)
+{
+    qsort(r->commands, (size_t)r->count, sizeof(Render_Command), render_compare);
+
+    r->submitted = r->count;
+    r->draw_calls = 0;
+
+    int start = 0;
+    while (start < r->count)
+    {
+        uint64_t key = r->commands[start].key;
+        int end = start + 1;
+        while (end < r->count && r->commands[end].key == key) end += 1;
+
+        Command_Kind kind = (Command_Kind)((key >> 48) & 0xFF);
+        Uint8 red   = (Uint8)(key >> 24);
+        Uint8 green = (Uint8)(key >> 16);
+        Uint8 blue  = (Uint8)(key >> 8);
+        Uint8 alpha = (Uint8)key;
+
+        switch (kind)
+        {
+            case Command_RECT:
+            {
+                for (int i = start; i < end; i += 1) r->rects[i - start] = r->commands[i].rect;
+
+                SDL_SetRenderDrawColor(r->renderer, red, green, blue, alpha);
+                SDL_RenderFillRects(r->renderer, r->rects, end - start);
+                r->draw_calls += 2;
+            } break;
+
+            case Command_POINT:
+            {
+                for (int i = start; i < end; i += 1) r->points[i - start] = (SDL_Point){r->commands[i].rect.x, r->commands[i].rect.y};
+
+                SDL_SetRenderDrawColor(r->renderer, red, green, blue, alpha);
+                SDL_RenderDrawPoints(r->renderer, r->points, end - start);
+                r->draw_calls += 2;
+            } break;
+
+            case Command_TEXTURE:
+            {
+                SDL_Texture *texture = r->textures[(key >> 40) & 0xFF];
+                SDL_SetTextureColorMod(texture, red, green, blue);
+                SDL_SetTextureAlphaMod(texture, alpha);
+                r->draw_calls += 2;
+
+                // SDL 2.0.9 has no way to submit many copies at once.
+                for (int i = start; i < end; i += 1)
+                {
+                    SDL_RenderCopy(r->renderer, texture, &r->commands[i].source, &r->commands[i].rect);
+                }
+
+                r->draw_calls += end - start;
+            } break;
+        }
+
+        start = end;
+    }
+
+    r->count = 0;
+    r->texture_count = 0;
+}
@@ -0,0 +1,274 @@
+// Replays: a game stored as its seed and the inputs of each tick, so it can be
+// simulated again exactly instead of storing what it looked like.
+//
+// Layout, little endian:
+//   "TRPL", version (1 byte), simulation rate in ticks a second (4 bytes), seed (8 bytes),
+//   line clear time in microseconds (4 bytes)
+//   then one event per tick that had input: ticks since the last event as a
+//   LEB128 varint, then the input bits. An event with no input bits ends the
+//   game, at the tick count it carries.
+
+#define REPLAY_VERSION     2
+#define REPLAY_HEADER_SIZE 21
+
+typedef enum {
+    Input_LEFT                     = 1 << 0,
+    Input_RIGHT                    = 1 << 1,
+    Input_DOWN                     = 1 << 2,
+    Input_DROP                     = 1 << 3,
+    Input_ROTATE_CLOCKWISE         = 1 << 4,
+    Input_ROTATE_COUNTER_CLOCKWISE = 1 << 5,
+} Input;
+
+typedef struct {
+    uint64_t seed;
+    int rate;
+    uint32_t clear_time;
+
+    uint8_t *data;
+    size_t length;
+    size_t capacity;
+
+    // Recording: ticks so far, and the tick of the last event written.
+    uint64_t tick;
+    uint64_t last_event;
+} Replay;
+
+typedef struct {
+    Replay *replay;
+    size_t cursor;
+
+    uint64_t tick;
+    uint64_t next_event;
+    uint8_t next_input;
+    bool done;
+} Replay_Player;
+
+uint8_t game_get_input(Game *g)
+{
+    uint8_t input = 0;
+    if (g->do_left_move)                input |= Input_LEFT;
+    if (g->do_right_move)               input |= Input_RIGHT;
+    if (g->do_down_move)                input |= Input_DOWN;
+    if (g->do_drop)                     input |= Input_DROP;
+    if (g->do_rotate_clockwise)         input |= Input_ROTATE_CLOCKWISE;
+    if (g->do_rotate_counter_clockwise) input |= Input_ROTATE_COUNTER_CLOCKWISE;
+    return input;
+}
+
+void game_set_input(Game *g, uint8_t input)
+{
+    g->do_left_move                = (input & Input_LEFT) != 0;
+    g->do_right_move               = (input & Input_RIGHT) != 0;
+    g->do_down_move                = (input & Input_DOWN) != 0;
+    g->do_drop                     = (input & Input_DROP) != 0;
+    g->do_rotate_clockwise         = (input & Input_ROTATE_CLOCKWISE) != 0;
+    g->do_rotate_counter_clockwise = (input & Input_ROTATE_COUNTER_CLOCKWISE) != 0;
+}
+
+static void replay_write_byte(Replay *r, uint8_t byte)
+{
+    if (r->length == r->capacity)
+    {
+        r->capacity = r->capacity ? r->capacity * 2 : 4096;
+        r->data = realloc(r->data, r->capacity);
+    }
+
+    r->data[r->length++] = byte;
+}
+
+static void replay_write_varint(Replay *r, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        replay_write_byte(r, (uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+
+    replay_write_byte(r, (uint8_t)value);
+}
+
+static void replay_write_le(Replay *r, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i += 1)
+    {
+        replay_write_byte(r, (uint8_t)(value >> (8 * i)));
+    }
+}
+
+static uint64_t replay_read_le(uint8_t *p, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i += 1)
+    {
+        value |= (uint64_t)p[i] << (8 * i);
+    }
+
+    return value;
+}
+
+// Start recording a game of g, throwing away whatever was recorded before.
+void replay_begin(Replay *r, Game *g, int rate)
+{
+    r->seed = g->seed;
+    r->rate = rate;
+    r->clear_time = (uint32_t)g->clear_time;
+    r->length = 0;
+    r->tick = 0;
+    r->last_event = 0;
+
+    replay_write_byte(r, 'T');
+    replay_write_byte(r, 'R');
+    replay_write_byte(r, 'P');
+    replay_write_byte(r, 'L');
+    replay_write_byte(r, REPLAY_VERSION);
+    replay_write_le(r, (uint64_t)rate, 4);
+    replay_write_le(r, r->seed, 8);
+    replay_write_le(r, r->clear_time, 4);
+}
+
+// Call before each game_update, with the inputs for that tick already set.
+void replay_record(Replay *r, Game *g)
+{
+    uint8_t input = game_get_input(g);
+
+    if (input)
+    {
+        replay_write_varint(r, r->tick - r->last_event);
+        replay_write_byte(r, input);
+        r->last_event = r->tick;
+    }
+
+    r->tick += 1;
+}
+
+// Mark the end of the game, after its last game_update.
+void replay_end(Replay *r)
+{
+    replay_write_varint(r, r->tick - r->last_event);
+    replay_write_byte(r, 0);
+    r->last_event = r->tick;
+}
+
+static FILE *replay_open(const char *path, const char *mode)
+{
+#ifdef _MSC_VER
+    FILE *file = NULL;
+    if (fopen_s(&file, path, mode)) return NULL;
+    return file;
+#else
+    return fopen(path, mode);
+#endif
+}
+
+bool replay_save(Replay *r, const char *path)
+{
+    FILE *file = replay_open(path, "wb");
+    if (!file) return false;
+
+    bool ok = fwrite(r->data, 1, r->length, file) == r->length;
+    fclose(file);
+    return ok;
+}
+
+bool replay_load(Replay *r, const char *path)
+{
+    FILE *file = replay_open(path, "rb");
+    if (!file) return false;
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    if (length < REPLAY_HEADER_SIZE)
+    {
+        fclose(file);
+        return false;
+    }
+
+    r->data = realloc(r->data, (size_t)length);
+    r->capacity = (size_t)length;
+    r->length = fread(r->data, 1, (size_t)length, file);
+    fclose(file);
+
+    if (r->length != (size_t)length || memcmp(r->data, "TRPL", 4) || r->data[4] != REPLAY_VERSION) return false;
+
+    r->rate = (int)replay_read_le(&r->data[5], 4);
+    r->seed = replay_read_le(&r->data[9], 8);
+    r->clear_time = (uint32_t)replay_read_le(&r->data[17], 4);
+    return r->rate > 0;
+}
+
+void replay_free(Replay *r)
+{
+    free(r->data);
+    r->data = NULL;
+    r->length = 0;
+    r->capacity = 0;
+}
+
+static void replay_player_read_event(Replay_Player *p)
+{
+    Replay *r = p->replay;
+    uint64_t delta = 0;
+    int shift = 0;
+
+    while (p->cursor < r->length)
+    {
+        uint8_t byte = r->data[p->cursor++];
+        delta |= (uint64_t)(byte & 0x7F) << shift;
+        shift += 7;
+        if (!(byte & 0x80)) break;
+    }
+
+    // A replay cut off mid event just ends there.
+    if (p->cursor >= r->length)
+    {
+        p->next_input = 0;
+    }
+    else
+    {
+        p->next_input = r->data[p->cursor++];
+    }
+
+    p->next_event += delta;
+}
+
+// Sets up g to play the replay from its first tick.
+void replay_player_init(Replay_Player *p, Replay *r, Game *g)
+{
+    p->replay = r;
+    p->cursor = REPLAY_HEADER_SIZE;
+    p->tick = 0;
+    p->next_event = 0;
+    p->done = false;
+    replay_player_read_event(p);
+
+    g->seed = r->seed;
+    g->clear_time = r->clear_time;
+    g->reset = true;
+}
+
+// Set this tick's inputs on g. Returns false once the replay is over, without
+// touching g, and true if game_update should be called.
+bool replay_play(Replay_Player *p, Game *g)
+{
+    if (p->done) return false;
+
+    uint8_t input = 0;
+    if (p->tick == p->next_event)
+    {
+        if (!p->next_input)
+        {
+            p->done = true;
+            return false;
+        }
+
+        input = p->next_input;
+        replay_player_read_event(p);
+    }
+
+    game_set_input(g, input);
+    p->tick += 1;
+    return true;
+}
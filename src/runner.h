@@ -0,0 +1,220 @@
+// Plays a batch of complete bot games on every core.
+//
+// Game indices are handed out work-stealing style. Each worker owns a range
+// [begin, end) of games packed into one 64 bit word. The owner takes games
+// off the front and idle workers split off the back half of someone else's
+// range, both with a compare-and-swap on that word, so no locks are needed.
+// A worker stops once its own range is empty and a pass over everyone else's
+// finds nothing to steal, so there's no shared counter for all of them to hit.
+//
+// Workers other than the calling thread are pinned to cores. They sit on
+// their own cache lines, with the range word on a line of its own so thieves
+// don't fight the owner over its counters, and keep their game state in
+// their own arena. Each game writes its result to its own slot, and the
+// per-worker totals are only added up after the join.
+
+typedef struct {
+    int score;
+    int pieces;
+    long long ticks;
+} Game_Result;
+
+typedef struct Runner Runner;
+
+typedef struct {
+    // Packed (begin << 32) | end, see the top of the file.
+    volatile uint64_t range;
+    uint8_t range_padding[CACHE_LINE - sizeof(uint64_t)];
+
+    Runner *runner;
+    int id;
+    int core;
+    Thread thread;
+
+    long long games;
+    long long pieces;
+    long long lines;
+    long long ticks;
+    long long steals;
+} Worker;
+
+// Each worker gets whole cache lines to itself.
+typedef union {
+    Worker worker;
+    uint8_t padding[(sizeof(Worker) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE];
+} Padded_Worker;
+
+struct Runner {
+    Padded_Worker *workers;
+    int worker_count;
+
+    Game_Result *results;
+    int games;
+    int max_pieces;
+
+    // Simulation ticks a second, see game_tick_dt, and how long line clears take.
+    int rate;
+    uint64_t clear_time;
+
+    // Game i is dealt pieces from seed + i, whichever worker plays it.
+    uint64_t seed;
+};
+
+#define RUNNER_WORKER_MEMORY (256 * 1024)
+
+static inline uint64_t runner_pack(uint32_t begin, uint32_t end)
+{
+    return ((uint64_t)begin << 32) | end;
+}
+
+// Take the next game off the front of our own range. Returns -1 if it's empty.
+int runner_pop(Worker *w)
+{
+    for (;;)
+    {
+        uint64_t range = atomic_load_u64(&w->range);
+        uint32_t begin = (uint32_t)(range >> 32);
+        uint32_t end = (uint32_t)range;
+
+        if (begin >= end) return -1;
+        if (atomic_compare_swap_u64(&w->range, range, runner_pack(begin + 1, end))) return (int)begin;
+    }
+}
+
+// Split off the back half of another worker's range. Returns one game to play
+// now and leaves the rest of the stolen games in our own range.
+int runner_steal(Worker *thief)
+{
+    Runner *r = thief->runner;
+
+    for (int i = 1; i < r->worker_count; i += 1)
+    {
+        Worker *victim = &r->workers[(thief->id + i) % r->worker_count].worker;
+
+        uint64_t range = atomic_load_u64(&victim->range);
+        uint32_t begin = (uint32_t)(range >> 32);
+        uint32_t end = (uint32_t)range;
+        if (begin >= end) continue;
+
+        uint32_t middle = begin + (end - begin) / 2;
+        if (!atomic_compare_swap_u64(&victim->range, range, runner_pack(begin, middle))) continue;
+
+        // Our range is empty, and nobody steals from an empty range, so this can't race.
+        uint64_t own = atomic_load_u64(&thief->range);
+        atomic_compare_swap_u64(&thief->range, own, runner_pack(middle + 1, end));
+
+        thief->steals += 1;
+        TRACE_INSTANT(steal, middle);
+        return (int)middle;
+    }
+
+    return -1;
+}
+
+void runner_play(Worker *w, Game *game, Bot *bot, int index)
+{
+    Runner *r = w->runner;
+    long long ticks = 0;
+
+    TRACE_BEGIN(game);
+
+    memset(bot, 0, sizeof(Bot));
+    game->seed = r->seed + (uint64_t)index;
+    game->preview = 1;
+    game->clear_time = r->clear_time;
+    game_reset(game);
+
+    while (!game->reset && game->board.pieces < r->max_pieces)
+    {
+        bot_drive(bot, game);
+        game_update(game, game_tick_dt(r->rate, (uint64_t)ticks));
+        ticks += 1;
+    }
+
+    Game_Result *result = &r->results[index];
+    result->score = game->board.score;
+    result->pieces = game->board.pieces;
+    result->ticks = ticks;
+
+    w->games += 1;
+    w->pieces += game->board.pieces;
+    w->lines += game->board.score;
+    w->ticks += ticks;
+
+    TRACE_END_VALUE(game, index);
+}
+
+int runner_worker(void *data)
+{
+    Worker *w = data;
+
+    // Worker 0 is the caller's thread, which shouldn't stay pinned once we return.
+    if (w->id > 0) thread_pin_to_core(w->core);
+
+    char name[32];
+    snprintf(name, 32, "worker %d", w->id);
+    trace_thread_name(name);
+
+    // Allocated on the worker's own thread, so the pages are local to its core.
+    void *memory = malloc(RUNNER_WORKER_MEMORY);
+    Arena arena;
+    arena_init(&arena, memory, RUNNER_WORKER_MEMORY);
+
+    Game *game = arena_alloc_aligned(&arena, sizeof(Game), CACHE_LINE);
+    Bot *bot = arena_alloc_aligned(&arena, sizeof(Bot), CACHE_LINE);
+    game_init(game, &arena);
+
+    for (;;)
+    {
+        int index = runner_pop(w);
+        if (index < 0) index = runner_steal(w);
+
+        // Nothing left here or anywhere else. Games a thief is still moving
+        // into its own range are its to play, so nothing is missed.
+        if (index < 0) break;
+
+        runner_play(w, game, bot, index);
+    }
+
+    free(memory);
+    return 0;
+}
+
+// Play games on worker_count threads (0 for one per core). results needs room for games entries.
+void runner_run(Runner *r, Arena *arena, int worker_count, int games, Game_Result *results)
+{
+    int cores = cpu_count();
+    if (worker_count <= 0) worker_count = cores;
+    if (worker_count > games) worker_count = games > 0 ? games : 1;
+
+    r->workers = arena_alloc_aligned(arena, sizeof(Padded_Worker) * (size_t)worker_count, CACHE_LINE);
+    r->worker_count = worker_count;
+    r->results = results;
+    r->games = games;
+
+    // Start everyone with an even share. Stealing evens out the rest.
+    for (int i = 0; i < worker_count; i += 1)
+    {
+        Worker *w = &r->workers[i].worker;
+        w->runner = r;
+        w->id = i;
+        w->core = i % cores;
+
+        uint32_t begin = (uint32_t)((long long)games * i / worker_count);
+        uint32_t end = (uint32_t)((long long)games * (i + 1) / worker_count);
+        w->range = runner_pack(begin, end);
+    }
+
+    for (int i = 1; i < worker_count; i += 1)
+    {
+        thread_start(&r->workers[i].worker.thread, runner_worker, &r->workers[i].worker);
+    }
+
+    // The calling thread is worker 0.
+    runner_worker(&r->workers[0].worker);
+
+    for (int i = 1; i < worker_count; i += 1)
+    {
+        thread_join(&r->workers[i].worker.thread);
+    }
+}
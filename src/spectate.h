@@ -0,0 +1,310 @@
+// A spectator view: many bot games simulated side by side and drawn in a grid,
+// for keeping an eye on bot runs. Every board goes through one render buffer,
+// so the same color or sprite across all boards is one batch.
+//
+// Boards with big enough cells are drawn in detail: cells are tinted copies of
+// a sprite from a small atlas, with the ghost and the score. Small boards are
+// plain rects with runs of same colored cells merged, and no ghost or text.
+
+#define SPECTATE_MAX_GAMES   144
+#define SPECTATE_MAX_PIECES  1000
+
+// Cells at least this many pixels wide get the detailed drawing.
+#define SPECTATE_DETAIL_CELL 10
+
+// Height of the line of text above the grid.
+#define SPECTATE_HEADER      24
+
+// The sprite atlas: a block and a ghost outline, side by side.
+#define SPECTATE_SPRITE_SIZE 16
+
+// Worst case is every cell of every board being its own command.
+#define SPECTATE_RENDER_COMMANDS (SPECTATE_MAX_GAMES * (BOARD_WIDTH * BOARD_HEIGHT + 16) + 256)
+
+typedef struct {
+    Game *games;
+    Bot *bots;
+    int count;
+
+    // Finished games start over with the next seed.
+    uint64_t next_seed;
+    uint64_t clear_time;
+    long long finished;
+
+    SDL_Texture *sprites;
+
+    // Worked out from the window size every frame.
+    int columns;
+    int cell_size;
+    int origin_x;
+    int origin_y;
+} Spectator;
+
+size_t spectate_memory_size(int count)
+{
+    return (size_t)count * (sizeof(Game) + sizeof(Bot) + game_memory_size() + 2 * sizeof(void *)) + 2 * sizeof(uint64_t);
+}
+
+static void spectate_start_game(Spectator *s, int i)
+{
+    Game *g = &s->games[i];
+    memset(&s->bots[i], 0, sizeof(Bot));
+
+    g->seed = s->next_seed;
+    g->preview = 1;
+    g->clear_time = s->clear_time;
+    game_reset(g);
+
+    s->next_seed += 1;
+}
+
+// Shades of white, so the color mod gives each cell its color.
+static SDL_Texture *spectate_make_sprites(SDL_Renderer *renderer)
+{
+    int size = SPECTATE_SPRITE_SIZE;
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, 2 * size, size, 32, SDL_PIXELFORMAT_RGBA32);
+    if (!surface) return NULL;
+
+    for (int y = 0; y < size; y += 1)
+    {
+        uint32_t *row = (uint32_t *)((uint8_t *)surface->pixels + y * surface->pitch);
+
+        for (int x = 0; x < size; x += 1)
+        {
+            bool edge = x == 0 || y == 0 || x == size - 1 || y == size - 1;
+
+            // Block: lit from the top left.
+            Uint8 shade = 210;
+            if (x < 2 || y < 2) shade = 255;
+            else if (x >= size - 2 || y >= size - 2) shade = 130;
+            row[x] = SDL_MapRGBA(surface->format, shade, shade, shade, 255);
+
+            // Ghost: just the outline.
+            row[size + x] = edge ? SDL_MapRGBA(surface->format, 255, 255, 255, 255) : SDL_MapRGBA(surface->format, 0, 0, 0, 0);
+        }
+    }
+
+    SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
+    SDL_FreeSurface(surface);
+
+    if (texture) SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    return texture;
+}
+
+// The arena needs spectate_memory_size(count) bytes free. Game i starts with seed + i.
+bool spectate_init(Spectator *s, Arena *arena, SDL_Renderer *renderer, int count, uint64_t seed, uint64_t clear_time)
+{
+    if (count < 1) count = 1;
+    if (count > SPECTATE_MAX_GAMES) count = SPECTATE_MAX_GAMES;
+
+    s->count = count;
+    s->next_seed = seed;
+    s->clear_time = clear_time;
+    s->finished = 0;
+    s->games = arena_alloc_aligned(arena, (size_t)count * sizeof(Game), sizeof(uint64_t));
+    s->bots = arena_alloc_aligned(arena, (size_t)count * sizeof(Bot), sizeof(uint64_t));
+    if (!s->games || !s->bots) return false;
+
+    for (int i = 0; i < count; i += 1)
+    {
+        game_init(&s->games[i], arena);
+        spectate_start_game(s, i);
+    }
+
+    s->sprites = spectate_make_sprites(renderer);
+    return s->sprites != NULL;
+}
+
+void spectate_free(Spectator *s)
+{
+    if (s->sprites) SDL_DestroyTexture(s->sprites);
+    s->sprites = NULL;
+}
+
+// Run one tick of every game.
+void spectate_update(Spectator *s, Uint64 dt)
+{
+    for (int i = 0; i < s->count; i += 1)
+    {
+        Game *g = &s->games[i];
+
+        bot_drive(&s->bots[i], g);
+        game_update(g, dt);
+
+        if (g->reset || g->board.pieces >= SPECTATE_MAX_PIECES)
+        {
+            s->finished += 1;
+            spectate_start_game(s, i);
+        }
+    }
+}
+
+// Pick the number of columns that gives the biggest cells, then center the grid.
+static void spectate_layout(Spectator *s, int width, int height)
+{
+    int tile_w = BOARD_WIDTH + 1;
+    int tile_h = BOARD_HEIGHT + 1;
+    height -= SPECTATE_HEADER;
+
+    s->columns = 1;
+    s->cell_size = 0;
+
+    for (int columns = 1; columns <= s->count; columns += 1)
+    {
+        int rows = (s->count + columns - 1) / columns;
+        int cell_w = width / (columns * tile_w);
+        int cell_h = height / (rows * tile_h);
+        int cell = cell_w < cell_h ? cell_w : cell_h;
+
+        if (cell > s->cell_size)
+        {
+            s->cell_size = cell;
+            s->columns = columns;
+        }
+    }
+
+    if (s->cell_size < 1) s->cell_size = 1;
+
+    int rows = (s->count + s->columns - 1) / s->columns;
+    s->origin_x = (width - s->columns * tile_w * s->cell_size) / 2 + s->cell_size / 2;
+    s->origin_y = SPECTATE_HEADER + (height - rows * tile_h * s->cell_size) / 2 + s->cell_size / 2;
+}
+
+static void spectate_sprite(Render_Buffer *r, Spectator *s, int sprite, int x, int y)
+{
+    SDL_Rect source = {sprite * SPECTATE_SPRITE_SIZE, 0, SPECTATE_SPRITE_SIZE, SPECTATE_SPRITE_SIZE};
+    SDL_Rect dest = {x, y, s->cell_size, s->cell_size};
+    render_copy(r, s->sprites, &source, &dest);
+}
+
+static void spectate_tetronimo(Render_Buffer *r, Spectator *s, Tetronimo *t, int sprite, int origin_x, int origin_y, bool detailed)
+{
+    const uint16_t *shape = get_shape(t);
+
+    for (int j = 0; j < 4; j += 1)
+    {
+        for (int i = 0; i < 4; i += 1)
+        {
+            if (!(shape[j] & (1 << i))) continue;
+
+            int x = origin_x + (t->x + i) * s->cell_size;
+            int y = origin_y + (t->y + j) * s->cell_size;
+
+            if (detailed)
+            {
+                spectate_sprite(r, s, sprite, x, y);
+            }
+            else
+            {
+                SDL_Rect rect = {x, y, s->cell_size, s->cell_size};
+                render_fill_rect(r, &rect);
+            }
+        }
+    }
+}
+
+static void spectate_draw_board(Render_Buffer *r, Spectator *s, Game *g, int x, int y, bool detailed, Font *font)
+{
+    Board *b = &g->board;
+    int cell = s->cell_size;
+
+    render_set_layer(r, Layer_BOARD);
+    render_set_color(r, 35, 35, 35, 255);
+    SDL_Rect board_rect = {x, y, b->width * cell, b->height * cell};
+    render_fill_rect(r, &board_rect);
+
+    render_set_layer(r, Layer_CELLS);
+    for (int row = 0; row < b->height; row += 1)
+    {
+        uint16_t bits = b->rows[row];
+        if (!bits) continue;
+
+        bool clearing = (b->rows_to_clear & (1u << row)) != 0;
+        uint8_t *types = &b->cell_types[get_2d_index(0, row, b->width)];
+
+        int column = 0;
+        while (column < b->width)
+        {
+            if (!(bits & (1 << column)))
+            {
+                column += 1;
+                continue;
+            }
+
+            // A run of cells the same color, one rect for all of them when drawing simply.
+            int end = column + 1;
+            while (!detailed && end < b->width && (bits & (1 << end)) && (clearing || types[end] == types[column])) end += 1;
+
+            Color color = clearing ? (Color){255, 255, 255, 255} : get_color((Tetronimo_Type)types[column]);
+            render_set_color(r, color.r, color.g, color.b, 255);
+
+            if (detailed)
+            {
+                spectate_sprite(r, s, 0, x + column * cell, y + row * cell);
+            }
+            else
+            {
+                SDL_Rect rect = {x + column * cell, y + row * cell, (end - column) * cell, cell};
+                render_fill_rect(r, &rect);
+            }
+
+            column = end;
+        }
+    }
+
+    Tetronimo *t = get_active(b);
+    if (t)
+    {
+        Color color = get_color(t->type);
+
+        if (detailed)
+        {
+            Tetronimo ghost = *t;
+            ghost.y = b->ghost_y;
+
+            render_set_layer(r, Layer_GHOST);
+            render_set_color(r, color.r, color.g, color.b, 255);
+            spectate_tetronimo(r, s, &ghost, 1, x, y, true);
+        }
+
+        render_set_layer(r, Layer_PIECE);
+        render_set_color(r, color.r, color.g, color.b, 255);
+        spectate_tetronimo(r, s, t, 0, x, y, detailed);
+    }
+
+    if (detailed)
+    {
+        char buf[50];
+        sprintf_s(buf, 50, "%d", b->score);
+
+        render_set_layer(r, Layer_HUD);
+        draw_text(r, x + 2, y + 2, buf, font, (SDL_Color){225, 225, 225, 225});
+    }
+}
+
+void spectate_render(Render_Buffer *r, Spectator *s, Font *font, int width, int height)
+{
+    spectate_layout(s, width, height);
+    bool detailed = s->cell_size >= SPECTATE_DETAIL_CELL;
+
+    SDL_SetRenderDrawColor(r->renderer, 0, 0, 0, 255);
+    SDL_RenderClear(r->renderer);
+
+    int tile_w = (BOARD_WIDTH + 1) * s->cell_size;
+    int tile_h = (BOARD_HEIGHT + 1) * s->cell_size;
+
+    for (int i = 0; i < s->count; i += 1)
+    {
+        int x = s->origin_x + (i % s->columns) * tile_w;
+        int y = s->origin_y + (i / s->columns) * tile_h;
+        spectate_draw_board(r, s, &s->games[i], x, y, detailed, font);
+    }
+
+    char buf[100];
+    sprintf_s(buf, 100, "%d games, %lld finished, %d commands in %d calls last frame", s->count, s->finished, r->submitted, r->draw_calls);
+
+    render_set_layer(r, Layer_HUD);
+    draw_text(r, 4, 2, buf, font, (SDL_Color){225, 225, 225, 225});
+
+    render_flush(r);
+}
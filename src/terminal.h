@@ -0,0 +1,257 @@
+// A terminal view of a game, for watching over SSH. It keeps a copy of what
+// it last put on the terminal and only writes the cells that changed since,
+// as 256 color ANSI escape codes, with one write per frame. A frame where
+// nothing moved writes nothing.
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Board cells are two characters wide so they come out roughly square.
+// Layout: a border around the board, then the preview and the score to its right.
+#define TERMINAL_BOARD_X  2
+#define TERMINAL_PANEL_X  (TERMINAL_BOARD_X + 2*BOARD_WIDTH + 4)
+#define TERMINAL_COLUMNS  (TERMINAL_PANEL_X + 12)
+#define TERMINAL_ROWS     (BOARD_HEIGHT + 2)
+
+// Enough for every cell to need a cursor move and a color change.
+#define TERMINAL_OUTPUT_SIZE (TERMINAL_ROWS * TERMINAL_COLUMNS * 32 + 64)
+
+typedef struct {
+    char glyph;
+    uint8_t foreground;
+    uint8_t background;
+} Terminal_Cell;
+
+typedef struct {
+    // What the terminal shows now, and the frame being built.
+    Terminal_Cell screen[TERMINAL_ROWS][TERMINAL_COLUMNS];
+    Terminal_Cell next[TERMINAL_ROWS][TERMINAL_COLUMNS];
+
+    // Where the cursor is and which colors are set, -1 if unknown.
+    int cursor_row;
+    int cursor_column;
+    int foreground;
+    int background;
+
+    char output[TERMINAL_OUTPUT_SIZE];
+    size_t length;
+
+    // Frames drawn and bytes written, since terminal_begin.
+    long long frames;
+    long long bytes;
+} Terminal;
+
+// The nearest color in the xterm 256 color palette.
+uint8_t terminal_color(Color c)
+{
+    if (c.r == c.g && c.g == c.b)
+    {
+        if (c.r < 8) return 16;
+        if (c.r > 238) return 231;
+        return (uint8_t)(232 + (c.r - 8) / 10);
+    }
+
+    int r = c.r < 48 ? 0 : c.r < 115 ? 1 : (c.r - 35) / 40;
+    int g = c.g < 48 ? 0 : c.g < 115 ? 1 : (c.g - 35) / 40;
+    int b = c.b < 48 ? 0 : c.b < 115 ? 1 : (c.b - 35) / 40;
+    return (uint8_t)(16 + 36*r + 6*g + b);
+}
+
+static void terminal_write(Terminal *t)
+{
+    size_t written = 0;
+    while (written < t->length)
+    {
+#ifdef _WIN32
+        int n = _write(1, t->output + written, (unsigned int)(t->length - written));
+#else
+        ssize_t n = write(1, t->output + written, t->length - written);
+#endif
+        if (n <= 0) break;
+        written += (size_t)n;
+    }
+
+    t->bytes += (long long)t->length;
+    t->length = 0;
+}
+
+static void terminal_append(Terminal *t, const char *string)
+{
+    size_t length = strlen(string);
+    if (t->length + length > TERMINAL_OUTPUT_SIZE) return;
+
+    memcpy(t->output + t->length, string, length);
+    t->length += length;
+}
+
+// Clear the terminal and hide the cursor. The first frame after this draws every cell.
+void terminal_begin(Terminal *t)
+{
+#ifdef _WIN32
+    // Windows consoles only understand escape codes when asked to.
+    HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD mode = 0;
+    if (GetConsoleMode(console, &mode)) SetConsoleMode(console, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+#endif
+
+    memset(t->screen, 0, sizeof(t->screen));
+    t->cursor_row = -1;
+    t->cursor_column = -1;
+    t->foreground = -1;
+    t->background = -1;
+    t->length = 0;
+    t->frames = 0;
+    t->bytes = 0;
+
+    terminal_append(t, "\x1b[0m\x1b[2J\x1b[?25l");
+    terminal_write(t);
+}
+
+// Put the colors and cursor back and move below the board.
+void terminal_end(Terminal *t)
+{
+    char buf[50];
+    snprintf(buf, 50, "\x1b[0m\x1b[?25h\x1b[%d;1H\n", TERMINAL_ROWS + 1);
+    terminal_append(t, buf);
+    terminal_write(t);
+}
+
+static void terminal_fill(Terminal *t, int row, int column, int width, char glyph, uint8_t foreground, uint8_t background)
+{
+    for (int i = column; i < column + width && i < TERMINAL_COLUMNS; i += 1)
+    {
+        if (row < 0 || row >= TERMINAL_ROWS || i < 0) continue;
+        t->next[row][i] = (Terminal_Cell){glyph, foreground, background};
+    }
+}
+
+static void terminal_text(Terminal *t, int row, int column, char *string)
+{
+    for (char *c = string; *c && column < TERMINAL_COLUMNS; c += 1, column += 1)
+    {
+        terminal_fill(t, row, column, 1, *c, 255, 16);
+    }
+}
+
+static void terminal_tetronimo(Terminal *t, Tetronimo *tetronimo, int origin_row, int origin_column, uint8_t color)
+{
+    const uint16_t *shape = get_shape(tetronimo);
+
+    for (int j = 0; j < 4; j += 1)
+    {
+        for (int i = 0; i < 4; i += 1)
+        {
+            if (shape[j] & (1 << i))
+            {
+                terminal_fill(t, origin_row + tetronimo->y + j, origin_column + 2*(tetronimo->x + i), 2, ' ', 16, color);
+            }
+        }
+    }
+}
+
+// Write out the cells of next that differ from screen.
+static void terminal_flush(Terminal *t)
+{
+    char buf[50];
+
+    for (int row = 0; row < TERMINAL_ROWS; row += 1)
+    {
+        for (int column = 0; column < TERMINAL_COLUMNS; column += 1)
+        {
+            Terminal_Cell *want = &t->next[row][column];
+            Terminal_Cell *have = &t->screen[row][column];
+
+            if (want->glyph == have->glyph && want->foreground == have->foreground && want->background == have->background) continue;
+
+            if (row != t->cursor_row || column != t->cursor_column)
+            {
+                snprintf(buf, 50, "\x1b[%d;%dH", row + 1, column + 1);
+                terminal_append(t, buf);
+            }
+
+            if (want->foreground != t->foreground || want->background != t->background)
+            {
+                snprintf(buf, 50, "\x1b[38;5;%d;48;5;%dm", want->foreground, want->background);
+                terminal_append(t, buf);
+                t->foreground = want->foreground;
+                t->background = want->background;
+            }
+
+            if (t->length < TERMINAL_OUTPUT_SIZE) t->output[t->length++] = want->glyph;
+
+            *have = *want;
+            t->cursor_row = row;
+            t->cursor_column = column + 1;
+        }
+    }
+
+    if (t->length > 0) terminal_write(t);
+    t->frames += 1;
+}
+
+void terminal_draw_game(Terminal *t, Game *g)
+{
+    Board *b = &g->board;
+    uint8_t border = terminal_color((Color){100, 100, 100, 255});
+    uint8_t empty = terminal_color((Color){35, 35, 35, 255});
+
+    for (int row = 0; row < TERMINAL_ROWS; row += 1)
+    {
+        terminal_fill(t, row, 0, TERMINAL_COLUMNS, ' ', 255, 16);
+    }
+
+    terminal_fill(t, 0, 0, TERMINAL_PANEL_X - 2, ' ', 16, border);
+    terminal_fill(t, TERMINAL_ROWS - 1, 0, TERMINAL_PANEL_X - 2, ' ', 16, border);
+
+    for (int row = 0; row < b->height; row += 1)
+    {
+        int y = row + 1;
+        bool clearing = (b->rows_to_clear & (1u << row)) != 0;
+
+        terminal_fill(t, y, 0, 2, ' ', 16, border);
+        terminal_fill(t, y, TERMINAL_BOARD_X + 2*b->width, 2, ' ', 16, border);
+
+        for (int column = 0; column < b->width; column += 1)
+        {
+            uint8_t color = empty;
+
+            if (b->rows[row] & (1 << column))
+            {
+                color = clearing ? 231 : terminal_color(get_color((Tetronimo_Type)b->cell_types[get_2d_index(column, row, b->width)]));
+            }
+
+            terminal_fill(t, y, TERMINAL_BOARD_X + 2*column, 2, ' ', 16, color);
+        }
+    }
+
+    Tetronimo *a = get_active(b);
+    if (a)
+    {
+        Color color = get_color(a->type);
+        Color ghost_color = {(uint8_t)(color.r/5), (uint8_t)(color.g/5), (uint8_t)(color.b/5), 255};
+
+        Tetronimo ghost = *a;
+        ghost.y = b->ghost_y;
+        terminal_tetronimo(t, &ghost, 1, TERMINAL_BOARD_X, terminal_color(ghost_color));
+        terminal_tetronimo(t, a, 1, TERMINAL_BOARD_X, terminal_color(color));
+    }
+
+    for (int p = 0; p < b->randomizer.preview; p += 1)
+    {
+        Tetronimo next = make_tetronimo((Tetronimo_Type)randomizer_peek(&b->randomizer, p), 0, 0);
+        terminal_tetronimo(t, &next, 1 + 3*p, TERMINAL_PANEL_X, terminal_color(get_color(next.type)));
+    }
+
+    char buf[50];
+    snprintf(buf, 50, "Score %d", b->score);
+    terminal_text(t, TERMINAL_ROWS - 3, TERMINAL_PANEL_X, buf);
+
+    snprintf(buf, 50, "%llu.%03llu", (unsigned long long)(g->timer / 1000000), (unsigned long long)(g->timer / 1000 % 1000));
+    terminal_text(t, TERMINAL_ROWS - 2, TERMINAL_PANEL_X, buf);
+
+    terminal_flush(t);
+}
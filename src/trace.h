@@ -0,0 +1,268 @@
+// A timeline of what every thread was doing, written as a Chrome trace
+// (open it in chrome://tracing or ui.perfetto.dev) for finding hitches and
+// threads waiting on each other after the fact.
+//
+// Each thread that traces gets its own ring of events, so recording one
+// takes no locks: the thread fills the slot at head and moves head on, and a
+// flusher thread writes out everything between tail and head to the file
+// every few milliseconds and moves tail on. When a ring is full new events
+// are dropped and counted. While tracing is off every trace point is one
+// load and a branch.
+//
+// Needs platform.h. Include before the game, so the game's own trace points
+// (locks and line clears) see the macros.
+
+#define TRACE_MAX_THREADS   64
+
+// Events per thread, a power of two.
+#define TRACE_BUFFER_EVENTS (1 << 16)
+
+#define TRACE_FLUSH_US      5000
+
+// duration for events that happen at a moment rather than over a time.
+#define TRACE_INSTANT_EVENT UINT64_MAX
+
+#ifdef _MSC_VER
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#else
+#define TRACE_THREAD_LOCAL _Thread_local
+#endif
+
+typedef struct {
+    // A string literal, from the trace macros.
+    const char *name;
+
+    // Nanoseconds since trace_start.
+    uint64_t start;
+    uint64_t duration;
+
+    int64_t value;
+} Trace_Event;
+
+typedef struct {
+    Trace_Event *events;
+
+    // Events are written at head by the owning thread and read at tail by the
+    // flusher. Each only writes its own.
+    volatile uint64_t head;
+    volatile uint64_t tail;
+
+    // The owner's last look at tail, so it only reads the flusher's when the ring looks full.
+    uint64_t tail_seen;
+    uint64_t dropped;
+
+    // Set once events is allocated, for the flusher.
+    volatile uint64_t ready;
+
+    char name[32];
+} Trace_Buffer;
+
+typedef struct {
+    volatile uint64_t enabled;
+    uint64_t origin;
+
+    Trace_Buffer buffers[TRACE_MAX_THREADS];
+    volatile uint64_t buffer_count;
+
+    FILE *file;
+    bool written;
+
+    Thread flusher;
+    volatile uint64_t stop;
+} Trace;
+
+static Trace trace;
+static TRACE_THREAD_LOCAL Trace_Buffer *trace_buffer;
+static TRACE_THREAD_LOCAL bool trace_no_buffer;
+
+// Put a span between these, in the same block. name is an identifier.
+#define TRACE_BEGIN(name) uint64_t trace_begin_##name = trace.enabled ? time_now_ns() : 0
+#define TRACE_END(name)   do { if (trace_begin_##name) trace_span(#name, trace_begin_##name, 0); } while (0)
+
+// The same, with a number to show with the span.
+#define TRACE_END_VALUE(name, value) do { if (trace_begin_##name) trace_span(#name, trace_begin_##name, (int64_t)(value)); } while (0)
+
+// Something that happened at one moment, with a number to go with it.
+#define TRACE_INSTANT(name, value) do { if (trace.enabled) trace_instant(#name, (int64_t)(value)); } while (0)
+
+// The calling thread's ring, made the first time it traces. NULL once there
+// are TRACE_MAX_THREADS of them.
+static Trace_Buffer *trace_thread_buffer(void)
+{
+    if (trace_buffer || trace_no_buffer) return trace_buffer;
+
+    uint64_t index = atomic_add_u64(&trace.buffer_count, 1) - 1;
+    Trace_Buffer *b = index < TRACE_MAX_THREADS ? &trace.buffers[index] : NULL;
+    if (b) b->events = malloc(TRACE_BUFFER_EVENTS * sizeof(Trace_Event));
+
+    if (!b || !b->events)
+    {
+        trace_no_buffer = true;
+        return NULL;
+    }
+
+    snprintf(b->name, sizeof(b->name), "thread %d", (int)index);
+    atomic_add_u64(&b->ready, 1);
+
+    trace_buffer = b;
+    return b;
+}
+
+static void trace_write(const char *name, uint64_t start, uint64_t duration, int64_t value)
+{
+    // A span that started before trace_stop can end after it.
+    if (!trace.enabled) return;
+
+    Trace_Buffer *b = trace_thread_buffer();
+    if (!b) return;
+
+    uint64_t head = b->head;
+    if (head - b->tail_seen >= TRACE_BUFFER_EVENTS)
+    {
+        b->tail_seen = atomic_load_u64(&b->tail);
+        if (head - b->tail_seen >= TRACE_BUFFER_EVENTS)
+        {
+            b->dropped += 1;
+            return;
+        }
+    }
+
+    Trace_Event *e = &b->events[head & (TRACE_BUFFER_EVENTS - 1)];
+    e->name = name;
+    e->start = start - trace.origin;
+    e->duration = duration;
+    e->value = value;
+
+    // Publishes the event to the flusher.
+    atomic_add_u64(&b->head, 1);
+}
+
+void trace_span(const char *name, uint64_t begin, int64_t value)
+{
+    trace_write(name, begin, time_now_ns() - begin, value);
+}
+
+void trace_instant(const char *name, int64_t value)
+{
+    trace_write(name, time_now_ns(), TRACE_INSTANT_EVENT, value);
+}
+
+// Name the calling thread in the trace. Does nothing while tracing is off.
+void trace_thread_name(const char *name)
+{
+    if (!trace.enabled) return;
+
+    Trace_Buffer *b = trace_thread_buffer();
+    if (b) snprintf(b->name, sizeof(b->name), "%s", name);
+}
+
+static void trace_separator(void)
+{
+    fputs(trace.written ? ",\n" : "\n", trace.file);
+    trace.written = true;
+}
+
+// Write out everything the threads have recorded since last time.
+static void trace_drain(void)
+{
+    uint64_t count = atomic_load_u64(&trace.buffer_count);
+    if (count > TRACE_MAX_THREADS) count = TRACE_MAX_THREADS;
+
+    for (uint64_t i = 0; i < count; i += 1)
+    {
+        Trace_Buffer *b = &trace.buffers[i];
+        if (!atomic_load_u64(&b->ready)) continue;
+
+        uint64_t head = atomic_load_u64(&b->head);
+        uint64_t tail = b->tail;
+
+        for (; tail < head; tail += 1)
+        {
+            Trace_Event *e = &b->events[tail & (TRACE_BUFFER_EVENTS - 1)];
+            trace_separator();
+
+            if (e->duration == TRACE_INSTANT_EVENT)
+            {
+                fprintf(trace.file, "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"args\":{\"value\":%lld}}",
+                        e->name, (int)i, (double)e->start / 1000.0, (long long)e->value);
+            }
+            else
+            {
+                fprintf(trace.file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"value\":%lld}}",
+                        e->name, (int)i, (double)e->start / 1000.0, (double)e->duration / 1000.0, (long long)e->value);
+            }
+        }
+
+        atomic_add_u64(&b->tail, head - b->tail);
+    }
+}
+
+static int trace_flusher(void *data)
+{
+    (void)data;
+
+    while (!atomic_load_u64(&trace.stop))
+    {
+        trace_drain();
+        sleep_us(TRACE_FLUSH_US);
+    }
+
+    return 0;
+}
+
+// Start tracing to a file. Once per run.
+bool trace_start(const char *path)
+{
+    trace.file = fopen(path, "wb");
+    if (!trace.file) return false;
+
+    fputs("{\"traceEvents\":[", trace.file);
+    trace.written = false;
+    trace.origin = time_now_ns();
+    trace.stop = 0;
+
+    if (!thread_start(&trace.flusher, trace_flusher, NULL))
+    {
+        fclose(trace.file);
+        trace.file = NULL;
+        return false;
+    }
+
+    atomic_add_u64(&trace.enabled, 1);
+    return true;
+}
+
+// Stop tracing and finish the file. Call once the other threads are done
+// tracing, their rings go away.
+void trace_stop(void)
+{
+    if (!trace.file) return;
+
+    atomic_add_u64(&trace.enabled, (uint64_t)-1);
+    atomic_add_u64(&trace.stop, 1);
+    thread_join(&trace.flusher);
+    trace_drain();
+
+    uint64_t count = trace.buffer_count < TRACE_MAX_THREADS ? trace.buffer_count : TRACE_MAX_THREADS;
+    long long dropped = 0;
+
+    for (uint64_t i = 0; i < count; i += 1)
+    {
+        Trace_Buffer *b = &trace.buffers[i];
+        if (!b->ready) continue;
+
+        trace_separator();
+        fprintf(trace.file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", (int)i, b->name);
+
+        dropped += (long long)b->dropped;
+        free(b->events);
+        b->events = NULL;
+        b->ready = 0;
+    }
+
+    fputs("\n]}\n", trace.file);
+    fclose(trace.file);
+    trace.file = NULL;
+
+    if (dropped > 0) fprintf(stderr, "trace: %lld events dropped, the rings were full\n", dropped);
+}
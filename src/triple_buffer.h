@@ -0,0 +1,60 @@
+// A triple buffer for handing values from one thread to another without locks
+// or waiting. There are three slots: the writer fills its back slot and
+// publishes it, which swaps it with the middle one, and the reader swaps the
+// middle one for its front slot when something new was published. Only the
+// slot indices move, the slots themselves live wherever the caller keeps them.
+//
+// The reader always gets the newest value. Values it never got round to are
+// written over, which is what a renderer wants from a simulation.
+
+// Set in middle when the slot there hasn't been taken by the reader yet.
+#define TRIPLE_BUFFER_FRESH 4
+
+typedef struct {
+    SDL_atomic_t middle;
+
+    // back is only touched by the writer, front only by the reader.
+    int back;
+    int front;
+} Triple_Buffer;
+
+void triple_buffer_init(Triple_Buffer *t)
+{
+    t->back = 0;
+    SDL_AtomicSet(&t->middle, 1);
+    t->front = 2;
+}
+
+// Writer: the slot to fill.
+int triple_buffer_back(Triple_Buffer *t)
+{
+    return t->back;
+}
+
+// Writer: hand over the back slot, and get another to fill next.
+void triple_buffer_publish(Triple_Buffer *t)
+{
+    // Everything written to the slot has to be visible before its index is.
+    SDL_MemoryBarrierRelease();
+    int old = SDL_AtomicSet(&t->middle, t->back | TRIPLE_BUFFER_FRESH);
+    t->back = old & 3;
+}
+
+// Reader: the slot to read, the newest published one. Returns false if
+// nothing was published since the last call, and the slot is the same as last time.
+bool triple_buffer_acquire(Triple_Buffer *t, int *slot)
+{
+    bool fresh = false;
+
+    if (SDL_AtomicGet(&t->middle) & TRIPLE_BUFFER_FRESH)
+    {
+        int old = SDL_AtomicSet(&t->middle, t->front);
+        SDL_MemoryBarrierAcquire();
+
+        t->front = old & 3;
+        fresh = true;
+    }
+
+    *slot = t->front;
+    return fresh;
+}
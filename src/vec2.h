@@ -77,3 +77,105 @@ static inline vec2 vec2_lerp(vec2 a, vec2 b, float t)
 {
     return vec2_add(vec2_scalar_multiply(a, 1-t), vec2_scalar_multiply(b, t));
 }
+
+// Four vec2s at once, the x's together and the y's together, for running
+// over arrays of them kept as separate x and y arrays. SSE where there is
+// any, plain loops otherwise.
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+#include <xmmintrin.h>
+#define VEC2_SSE 1
+
+typedef struct vec2x4_Struct
+{
+    __m128 x;
+    __m128 y;
+} vec2x4;
+
+static inline vec2x4 vec2x4_load(const float *x, const float *y)
+{
+    vec2x4 temp;
+    temp.x = _mm_loadu_ps(x);
+    temp.y = _mm_loadu_ps(y);
+    return temp;
+}
+
+static inline void vec2x4_store(vec2x4 a, float *x, float *y)
+{
+    _mm_storeu_ps(x, a.x);
+    _mm_storeu_ps(y, a.y);
+}
+
+static inline vec2x4 vec2x4_make(float x, float y)
+{
+    vec2x4 temp;
+    temp.x = _mm_set1_ps(x);
+    temp.y = _mm_set1_ps(y);
+    return temp;
+}
+
+static inline vec2x4 vec2x4_add(vec2x4 a, vec2x4 b)
+{
+    a.x = _mm_add_ps(a.x, b.x);
+    a.y = _mm_add_ps(a.y, b.y);
+    return a;
+}
+
+static inline vec2x4 vec2x4_scalar_multiply(vec2x4 a, float b)
+{
+    __m128 scale = _mm_set1_ps(b);
+    a.x = _mm_mul_ps(a.x, scale);
+    a.y = _mm_mul_ps(a.y, scale);
+    return a;
+}
+#else
+typedef struct vec2x4_Struct
+{
+    float x[4];
+    float y[4];
+} vec2x4;
+
+static inline vec2x4 vec2x4_load(const float *x, const float *y)
+{
+    vec2x4 temp;
+    memcpy(temp.x, x, sizeof(temp.x));
+    memcpy(temp.y, y, sizeof(temp.y));
+    return temp;
+}
+
+static inline void vec2x4_store(vec2x4 a, float *x, float *y)
+{
+    memcpy(x, a.x, sizeof(a.x));
+    memcpy(y, a.y, sizeof(a.y));
+}
+
+static inline vec2x4 vec2x4_make(float x, float y)
+{
+    vec2x4 temp;
+    for (int i = 0; i < 4; i += 1)
+    {
+        temp.x[i] = x;
+        temp.y[i] = y;
+    }
+    return temp;
+}
+
+static inline vec2x4 vec2x4_add(vec2x4 a, vec2x4 b)
+{
+    for (int i = 0; i < 4; i += 1)
+    {
+        a.x[i] += b.x[i];
+        a.y[i] += b.y[i];
+    }
+    return a;
+}
+
+static inline vec2x4 vec2x4_scalar_multiply(vec2x4 a, float b)
+{
+    for (int i = 0; i < 4; i += 1)
+    {
+        a.x[i] *= b;
+        a.y[i] *= b;
+    }
+    return a;
+}
+#endif